@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+/*
+ * Heap allocation counting for the control loops.  When built with
+ * MOVE_SMOOTH_ALLOC_CHECK (cmake -DMOVE_SMOOTH_ALLOC_CHECK=ON) the
+ * global operator new is replaced by one that counts the allocations
+ * made by each thread, otherwise nothing is counted and the checks
+ * below always pass.
+ */
+namespace alloc_counter
+{
+
+// Allocations made by the calling thread so far
+uint64_t count();
+
+// True if allocations are being counted
+bool enabled();
+
+// Allocations made while one of these is in scope are not counted, for
+// ROS calls that are known to allocate, such as publish()
+class Ignore
+{
+public:
+  Ignore();
+  ~Ignore();
+};
+
+}
+
+/*
+ * Checks that an iteration of a control loop does not allocate once it
+ * has warmed up.  begin() is called at the top of the part of the
+ * iteration being checked and end() at the bottom, usually through a
+ * Scope so that iterations that leave early are checked too.  Any
+ * allocation in between after the first `warmup` iterations is logged
+ * as an error, and aborts in debug builds.
+ */
+class AllocationCheck
+{
+  const char* name;
+  int warmup;
+  int iterations;
+  uint64_t start;
+  uint64_t failures;
+
+public:
+  AllocationCheck(const char* name, int warmup = 10);
+
+  void begin();
+  void end();
+
+  // Warm up again, for loops that are run once per goal and set up the
+  // goal in their first iterations
+  void restart();
+
+  // Checks one iteration, from construction to destruction
+  class Scope
+  {
+    AllocationCheck& check;
+
+  public:
+    explicit Scope(AllocationCheck& check) : check(check) { check.begin(); }
+    ~Scope() { check.end(); }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+  };
+
+  // Number of iterations after the warm up that allocated
+  uint64_t get_failures() const { return failures; }
+};
+
+#endif
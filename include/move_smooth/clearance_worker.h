@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef CLEARANCE_WORKER_H
+#define CLEARANCE_WORKER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "move_smooth/collision_checker.h"
+#include "move_smooth/update_trigger.h"
+#include "move_smooth/loop_stats.h"
+
+/*
+ * Perception thread: recomputes the Clearance whenever a new obstacle
+ * snapshot is published, and at least at min_rate so that old data
+ * ages out.  The result is published as an immutable, versioned
+ * Clearance that the control loops read without blocking, so the
+ * cost of the collision checks is independent of the control period.
+ *
+ * The worker is the only caller of the CollisionChecker once started.
+ */
+class ClearanceWorker
+{
+  CollisionChecker& checker;
+  ros::WallDuration period;
+
+  // Notified by ObstaclePoints
+  UpdateTrigger obstacles;
+  // Notified after each new clearance, if set
+  UpdateTrigger* trigger;
+  // Time taken by each clearance query, if set
+  LatencyHistogram* query_time;
+
+  // Velocity the arc is checked for
+  std::mutex velocity_mutex;
+  double linear;
+  double angular;
+
+  // Latest clearance, only accessed through std::atomic_load/store
+  std::shared_ptr<const Clearance> clearance;
+  // Recycled once no reader holds them
+  std::shared_ptr<Clearance> clearance_pool[3];
+
+  std::atomic<bool> running;
+  std::thread thread;
+
+  void loop();
+  void update();
+
+public:
+  ClearanceWorker(CollisionChecker& checker, double min_rate);
+  ~ClearanceWorker();
+
+  void start();
+  void stop();
+
+  // To be notified of new obstacle data
+  UpdateTrigger& obstacle_trigger() { return obstacles; }
+
+  // Notify trigger whenever a new clearance is published
+  void set_update_trigger(UpdateTrigger* trigger);
+
+  // Record how long each clearance query takes, call before start()
+  void set_query_histogram(LatencyHistogram* histogram) { query_time = histogram; }
+
+  // The last command sent, the arc clearance is for this
+  void set_velocity(double linear, double angular);
+
+  // Latest clearance, never blocks
+  std::shared_ptr<const Clearance> get_clearance() const;
+};
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#include <ros/ros.h>
+
+/*
+ * Source of the current time for the perception and control code.
+ * Everything that ages data or times out asks its Clock rather than
+ * ros::Time::now(), and the loops wait on it, so that it can be run
+ * from a replay or stepped by hand in a test as well as on the robot.
+ * Clocks are shared between threads, so now() and sleep_until() must be
+ * safe to call from any of them.
+ */
+class Clock
+{
+public:
+  virtual ~Clock() {}
+  virtual ros::Time now() const = 0;
+  // Block until now() has reached time
+  virtual void sleep_until(const ros::Time& time) const = 0;
+
+  // Shared RosClock, the default everywhere
+  static const Clock& ros_clock();
+};
+
+// ros::Time::now(), so wall time or /clock as ROS is set up
+class RosClock : public Clock
+{
+public:
+  ros::Time now() const override;
+  void sleep_until(const ros::Time& time) const override;
+};
+
+// Time that only moves when it is told to, sleepers wake up when another
+// thread moves it far enough
+class ManualClock : public Clock
+{
+  std::atomic<int64_t> nsec;
+  mutable std::mutex mutex;
+  mutable std::condition_variable moved;
+
+public:
+  explicit ManualClock(const ros::Time& start = ros::Time(1, 0));
+
+  ros::Time now() const override;
+  void sleep_until(const ros::Time& time) const override;
+  void set(const ros::Time& time);
+  void advance(const ros::Duration& duration);
+};
+
+/*
+ * ros::Rate on a Clock.  sleep() waits until a period after the last
+ * wake up, or doesn't wait and starts over if the loop has fallen more
+ * than a period behind or the time has gone backwards.
+ */
+class ClockRate
+{
+  const Clock& clock;
+  ros::Duration period;
+  ros::Time next;
+
+public:
+  ClockRate(const Clock& clock, double frequency);
+
+  void sleep();
+  const ros::Duration& expected_cycle_time() const { return period; }
+};
+
+#endif
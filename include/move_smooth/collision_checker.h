@@ -36,39 +36,73 @@
 #include <tf2_ros/buffer.h>
 #include <sensor_msgs/Range.h>
 #include <sensor_msgs/LaserScan.h>
+#include <visualization_msgs/MarkerArray.h>
 
-#include <mutex>
+#include <atomic>
 
 #include "move_smooth/obstacle_points.h"
+#include "move_smooth/collision_kernels.h"
+
+// Clearance around the robot, all computed from the same obstacle snapshot
+struct Clearance
+{
+   uint64_t version;      // version of the snapshot used
+   ros::Time stamp;       // time of the latest data in it
+
+   float forward;         // from the front edge to the closest obstacle ahead [m]
+   float rear;            // from the back edge to the closest obstacle behind [m]
+   float left;            // from the left side to the closest obstacle alongside [m]
+   float right;           // from the right side to the closest obstacle alongside [m]
+
+   float rotate_left;     // rotation in place possible to the left [rad]
+   float rotate_right;    // rotation in place possible to the right [rad]
+   float arc;             // see obstacle_arc_angle, M_PI if there is no arc
+};
 
 class CollisionChecker
 {
    std::string baseFrame;
    ros::Publisher line_pub;
+   // debug lines of the current query, published together
+   visualization_msgs::MarkerArray markers;
+   size_t marker_count;
+   ros::Time last_markers;
+   ros::Duration marker_period;
    tf2_ros::Buffer& tf_buffer;
    // footprint
    float robot_width;
    float robot_front_length;
    float robot_back_length;
 
-   float robot_width_sq;
-   float robot_front_length_sq;
-   float robot_back_length_sq;
-   float front_diag, back_diag;
+   collision_kernels::Footprint footprint;
+   // distance from base_link to the furthest corner, only obstacles
+   // within it can block a rotation in place
+   float rotate_radius;
 
    float max_age;
    float no_obstacle_dist;
-   std::mutex obstacle_mutex;
 
    ObstaclePoints& ob_points;
+   const Clock& clock;
 
    void draw_line(const tf2::Vector3 &p1, const tf2::Vector3 &p2,
                   float r, float g, float b, int id);
    void clear_line(int id);
+   visualization_msgs::Marker& next_marker();
+   bool start_markers(const ros::Time& now);
+   void publish_markers();
 
    void check_dist(float x, bool forward, float& min_dist) const;
-   void check_angle(float theta, float x, float y,
-                    bool left, float& min_dist) const;
+   void sweep_lines(const ObstacleSnapshot& snapshot, const ros::Time& now,
+                    collision_kernels::DistResult& result) const;
+   void sweep_points(const ObstacleSnapshot& snapshot, const ros::Time& now,
+                     collision_kernels::DistResult& result) const;
+   bool make_arc(double linear, double angular, collision_kernels::Arc& arc) const;
+   void arc_radii(const collision_kernels::Arc& arc, float& min_radius, float& max_radius) const;
+
+   void draw_dist(bool forward, float min_dist, float min_dist_left, float min_dist_right,
+                  const tf2::Vector3 &fl, const tf2::Vector3 &fr);
+   void draw_angle(bool left, float min_angle);
 
    float degrees(float radians) const;
 
@@ -77,6 +111,7 @@ public:
    // the useful life of this class, if they don't then you have a big issue.
    //
    // We don't store the NodeHandle, so that doesn't apply to it.
+   // Obstacles are aged by the clock of op.
    CollisionChecker(ros::NodeHandle& nh, tf2_ros::Buffer& tf_buffer, ObstaclePoints& op);
 
    // return distance in meters to closest obstacle
@@ -88,7 +123,14 @@ public:
    
    float obstacle_arc_angle(double linear, double angular);
 
-   double min_side_dist;
+   // compute all of the above from one obstacle snapshot, the arc
+   // is the one driven with the given velocities.  The distances take
+   // the sonar lines and a grid sweep of the points, rotation and arc
+   // share one walk of the polar rings.
+   void clearance(double linear, double angular, Clearance& out);
+
+   // set by the node while the clearance worker draws with it
+   std::atomic<double> min_side_dist;
    double max_side_dist;
 };
 
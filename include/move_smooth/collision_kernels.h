@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef COLLISION_KERNELS_H
+#define COLLISION_KERNELS_H
+
+#include <cstddef>
+
+/*
+ Inner loops of the CollisionChecker queries, written over the x and y
+ arrays of an ObstacleCloud.  Each kernel has a scalar version and, on
+ x86, SSE4.1 and AVX2 versions; the fastest one supported by the CPU is
+ picked the first time a kernel is called.
+*/
+namespace collision_kernels
+{
+
+// Robot footprint, as distances from base_link
+struct Footprint
+{
+    float width;
+    float front_length;
+    float back_length;
+};
+
+/*
+ Running minima for obstacle_dist.  forward and rear are the x
+ distances to the closest point within the robot width ahead of the
+ front edge and behind the back edge, left and right the y distances to
+ the closest point alongside the robot.  Callers initialise them to the
+ no obstacle distance.
+*/
+struct DistResult
+{
+    float forward;
+    float rear;
+    float left;
+    float right;
+};
+
+// Fold n points into result
+void dist_points(const Footprint& footprint, const float* x, const float* y,
+                 size_t n, DistResult& result);
+
+/*
+ Running minima for obstacle_angle: how far in radians the robot can
+ rotate in place to the left (counter clockwise) and to the right before
+ one of the points touches the footprint.  Callers initialise them to M_PI.
+*/
+struct AngleResult
+{
+    float left;
+    float right;
+};
+
+/*
+ Fold n points into result.  The scalar version uses std::atan2; the
+ vector versions use a polynomial atan2 and agree with it to within
+ 1e-5 radians.  A point within 1e-5 radians of the footprint is taken
+ to be touching it and blocks rotation in both directions.
+*/
+void angle_points(const Footprint& footprint, const float* x, const float* y,
+                  size_t n, AngleResult& result);
+
+/*
+ The arc swept by the robot driving with a constant linear and angular
+ velocity, in polar form around the centre of rotation (0, centre_y).
+ Obstacles between the two radii will be hit by the robot; outer_theta
+ is the bearing of the outer corner, where the sweep starts.
+*/
+struct Arc
+{
+    float centre_y;
+    float inner_radius_sq;
+    float outer_radius_sq;
+    float outer_theta;
+    bool forward;
+    bool left;
+};
+
+/*
+ Fold n points into closest, the smallest bearing around the centre of
+ rotation of a point that the robot would hit.  This is scalar only: an
+ atan2 is only needed for the few points inside the swept annulus.
+*/
+void arc_points(const Arc& arc, const float* x, const float* y,
+                size_t n, float& closest);
+
+// Name of the implementation in use, for logging
+const char* implementation();
+
+// Use the named implementation ("scalar", "sse4.1" or "avx2") from now
+// on, returns false if the CPU doesn't support it.  For tests and
+// benchmarks only, it must not be called while a kernel is running.
+bool set_implementation(const char* name);
+
+}
+
+#endif
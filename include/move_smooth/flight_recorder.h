@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * State of the control loop when a command was sent.  The layout is the
+ * file format, read by scripts/flight_decode.py, so fields are only
+ * ever added at the end with the version bumped.
+ */
+struct FlightRecord
+{
+  enum Mode : uint8_t { idle = 0, rotating = 1, following = 2 };
+  enum Flags : uint8_t { stopped = 1, obstacle = 2 };
+
+  double stamp;          // ROS time of the command [s]
+  uint32_t goal;         // number of the goal being executed, from 1
+  uint8_t mode;
+  uint8_t flags;
+  uint16_t reserved;
+
+  float x, y, yaw;       // robot pose in the driving frame [m, rad]
+  float distance;        // remaining to the goal [m]
+  float angle;           // remaining to the goal heading [rad]
+
+  float forward, rear, left, right;   // clearance [m]
+  float rotate_left, rotate_right;    // clearance [rad]
+  float clearance_age;   // how old the obstacle data was [s]
+
+  float linear;          // commanded velocities [m/s, rad/s]
+  float angular;
+};
+
+/*
+ * Fixed size ring of the latest FlightRecords, kept all the time and
+ * written out when a goal aborts or when the node is sent SIGUSR1, so
+ * there is something to go on afterwards.  Recording copies a record
+ * under an uncontended lock.
+ *
+ * The file is a FlightHeader followed by the records, oldest first.
+ */
+struct FlightHeader
+{
+  static const uint32_t current_version = 1;
+
+  char magic[8];         // "MSFLIGHT"
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t count;
+  uint32_t goal;         // goal being executed when written
+  double stamp;          // ROS time written [s]
+  char reason[128];      // NUL terminated
+};
+
+class FlightRecorder
+{
+  std::mutex mutex;
+  std::vector<FlightRecord> records;
+  uint64_t written;
+
+public:
+  explicit FlightRecorder(size_t capacity);
+
+  void record(const FlightRecord& record);
+
+  // Map path and write the records to it, returns false on failure
+  bool dump(const std::string& path, uint32_t goal, double stamp,
+            const std::string& reason);
+
+  // Note the signal so that signal_pending() returns true once
+  static void dump_on_signal(int signal);
+  static bool signal_pending();
+};
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef LATEST_VALUE_H
+#define LATEST_VALUE_H
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * A slot holding the latest value written, for one writer thread and
+ * one reader thread.  Neither side blocks or allocates: the writer
+ * fills its back buffer and swaps it with the middle one, the reader
+ * swaps the middle buffer with its front one when something new has
+ * been written (a triple buffer).
+ */
+template <typename T>
+class LatestValue
+{
+  static const uint8_t fresh = 4;
+
+  T buffers[3];
+  // index of the middle buffer, with `fresh` set if it is newer than
+  // the reader's front buffer
+  std::atomic<uint8_t> middle;
+  uint8_t back;        // writer only
+  uint8_t front;       // reader only
+  bool have_value;     // reader only
+
+public:
+  LatestValue() : middle(1), back(0), front(2), have_value(false) {}
+
+  void write(const T& value)
+  {
+      buffers[back] = value;
+      back = middle.exchange(back | fresh) & 3;
+  }
+
+  // Get the latest value, returns false if nothing was ever written
+  bool read(T& value)
+  {
+      if (middle.load() & fresh) {
+          front = middle.exchange(front) & 3;
+          have_value = true;
+      }
+      if (!have_value) {
+          return false;
+      }
+      value = buffers[front];
+      return true;
+  }
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef LOOP_STATS_H
+#define LOOP_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include <ros/ros.h>
+
+/*
+ * Histogram of durations in the style of HdrHistogram: exact below
+ * 64 ns, then 32 linear buckets for each power of two, so any value is
+ * within about 3% of its bucket.  Recording is a few atomic operations
+ * with no locks or allocation, so it can be used from the control
+ * loops while another thread reads it.
+ */
+class LatencyHistogram
+{
+  static const int sub_bucket_bits = 5;
+  static const int sub_buckets = 1 << sub_bucket_bits;
+  static const int linear_limit = 2 * sub_buckets;
+  static const int magnitudes = 34;
+  static const int buckets = linear_limit + magnitudes * sub_buckets;
+
+  std::atomic<uint64_t> counts[buckets];
+  std::atomic<uint64_t> total;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> maximum;
+  std::atomic<uint64_t> over_budget;
+  uint64_t budget;
+
+  static int bucket_of(uint64_t ns);
+  static uint64_t value_of(int bucket);
+
+public:
+  LatencyHistogram();
+
+  // Durations over budget are counted as overruns, 0 for no budget
+  void set_budget(const ros::WallDuration& budget) { this->budget = budget.toNSec(); }
+
+  void record(uint64_t ns);
+
+  uint64_t count() const { return total.load(std::memory_order_relaxed); }
+  uint64_t overruns() const { return over_budget.load(std::memory_order_relaxed); }
+  double mean_us() const;
+  double max_us() const;
+  // Value below which fraction p of the durations fall
+  double percentile_us(double p) const;
+};
+
+/*
+ * Timings of the stages of the control loops, published periodically
+ * as diagnostics and available as a text dump.  Cycle stages cover one
+ * whole iteration, wake_lateness is how late a loop woke up compared to
+ * its rate, stop_latency is how long the stop service took to publish
+ * the zero command, the others are parts of an iteration.
+ */
+class LoopStats
+{
+public:
+  enum Stage
+  {
+    follow_cycle,
+    rotate_cycle,
+    run_cycle,
+    wake_lateness,
+    tf_lookup,
+    obstacle_fetch,
+    clearance_query,
+    command_publish,
+    stop_latency,
+    stages
+  };
+
+  LoopStats();
+
+  LatencyHistogram& operator[](Stage stage) { return histograms[stage]; }
+  static const char* name(Stage stage);
+
+  // Fill in and publish a diagnostic_msgs/DiagnosticArray, stamped
+  // with stamp
+  void publish(ros::Publisher& pub, const ros::Time& stamp);
+  // Summary table, one line for each stage
+  std::string dump() const;
+
+private:
+  LatencyHistogram histograms[stages];
+  // Overruns at the last publish, to report new ones
+  uint64_t published_overruns[stages];
+};
+
+/*
+ * Records the time from construction to destruction in a histogram
+ */
+class StageTimer
+{
+  LatencyHistogram& histogram;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  explicit StageTimer(LatencyHistogram& histogram) : histogram(histogram),
+                                                     start(std::chrono::steady_clock::now())
+  {
+  }
+
+  ~StageTimer()
+  {
+      histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start).count());
+  }
+};
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef MOTION_PROFILE_H
+#define MOTION_PROFILE_H
+
+/*
+ * Jerk limited (double S) velocity profile for a move of a given
+ * distance, from a start speed to an end speed, after Biagiotti and
+ * Melchiorri, "Trajectory Planning for Automatic Machines and Robots",
+ * section 3.4.  The acceleration is taken to be zero at both ends.
+ *
+ * The profile is planned once, as up to seven phases of constant jerk,
+ * and then sampled by time, which costs a few multiplications.  If the
+ * end speed can't be reached within the distance it is moved towards
+ * the start speed until it can.
+ */
+class MotionProfile
+{
+public:
+  MotionProfile();
+
+  // Plan a move of distance >= 0, at speeds >= 0
+  void plan(double distance, double start_velocity, double end_velocity,
+            double max_velocity, double max_acceleration, double max_jerk);
+  void reset() { planned = false; }
+
+  bool valid() const { return planned; }
+  double get_distance() const { return distance; }
+  double get_duration() const { return start[phases]; }
+  double get_end_velocity() const { return velocity[phases]; }
+
+  // State at time t after the start of the profile, held at the end
+  // state after it finishes
+  double position_at(double t) const;
+  double velocity_at(double t) const;
+  double acceleration_at(double t) const;
+
+  // Distance still to go at time t
+  double remaining_at(double t) const { return distance - position_at(t); }
+
+private:
+  static const int phases = 7;
+
+  bool planned;
+  double distance;
+
+  // Start time, position, velocity and acceleration of each phase, and
+  // the state at the end
+  double start[phases + 1];
+  double position[phases + 1];
+  double velocity[phases + 1];
+  double acceleration[phases + 1];
+  double jerk[phases];
+
+  bool solve(double distance, double v0, double v1, double max_velocity,
+             double max_acceleration, double max_jerk, double durations[phases]);
+  int phase_at(double t) const;
+};
+
+#endif
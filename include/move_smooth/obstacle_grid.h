@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef OBSTACLE_GRID_H
+#define OBSTACLE_GRID_H
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "move_smooth/obstacle_cloud.h"
+
+/*
+ * Uniform grid of square cells centred on base_link, built once for
+ * each cloud.  The points are stored sorted by cell, so the points of a
+ * cell, or of a run of cells along y, are contiguous.  The obstacle_dist
+ * bands are swept a row of cells at a time moving away from the robot,
+ * stopping as soon as a row can't hold anything closer than what has
+ * already been found, so most of the points are never looked at.
+ *
+ * Points outside the grid are kept in a separate overflow cloud.
+ */
+class ObstacleGrid
+{
+public:
+  ObstacleGrid();
+
+  void configure(float cell_size, float extent);
+  void build(const ObstacleCloud& cloud);
+
+  /*
+   * Call f(x, y, n) for the points in the cells that overlap the band
+   * lo < y < hi, from distance `from` along x away from base_link, in
+   * the positive or negative x direction.  Before each row of cells,
+   * stop() is called for the smallest distance that is still of
+   * interest; the sweep ends once a row starts beyond it.
+   */
+  template <typename F, typename S>
+  void sweep_x(bool positive, float from, float lo, float hi, F f, S stop) const
+  {
+      sweep(true, positive, from, lo, hi, f, stop);
+  }
+
+  // As sweep_x, with x and y swapped
+  template <typename F, typename S>
+  void sweep_y(bool positive, float from, float lo, float hi, F f, S stop) const
+  {
+      sweep(false, positive, from, lo, hi, f, stop);
+  }
+
+  // Call f(x, y, n) for the points outside the grid
+  template <typename F>
+  void for_each_overflow(F f) const
+  {
+      if (!overflow.empty()) {
+          f(overflow.x.data(), overflow.y.data(), overflow.size());
+      }
+  }
+
+  size_t size() const { return points.size() + overflow.size(); }
+
+private:
+  float cell_size;
+  float extent;
+  int cells;            // per side
+
+  // Points sorted by cell, cell (ix, iy) is at ix * cells + iy and its
+  // points are [cell_start[cell], cell_start[cell + 1])
+  ObstacleCloud points;
+  std::vector<uint32_t> cell_start;
+  ObstacleCloud overflow;
+
+  // Cell of each input point, kept to avoid allocating on every build
+  std::vector<int32_t> point_cell;
+
+  int cell_of(float v) const
+  {
+      return (int) std::floor((v + extent) / cell_size);
+  }
+
+  int clamp(int i) const
+  {
+      return i < 0 ? 0 : (i >= cells ? cells - 1 : i);
+  }
+
+  template <typename F>
+  void run(int first, int last, F& f) const
+  {
+      uint32_t begin = cell_start[first];
+      uint32_t end = cell_start[last + 1];
+      if (end > begin) {
+          f(points.x.data() + begin, points.y.data() + begin, end - begin);
+      }
+  }
+
+  template <typename F, typename S>
+  void sweep(bool along_x, bool positive, float from, float lo, float hi,
+             F& f, S& stop) const
+  {
+      if (points.empty() || cell_of(hi) < 0 || cell_of(lo) >= cells) {
+          return;
+      }
+      const int lo_cell = clamp(cell_of(lo));
+      const int hi_cell = clamp(cell_of(hi));
+
+      const int step = positive ? 1 : -1;
+      int i = cell_of(positive ? from : -from);
+      if (positive ? i >= cells : i < 0) {
+          return;
+      }
+      i = clamp(i);
+
+      for (; 0 <= i && i < cells; i += step) {
+          // distance from base_link to the near edge of this row
+          float edge = positive ? -extent + i * cell_size
+                                : extent - (i + 1) * cell_size;
+          if (edge >= stop()) {
+              break;
+          }
+          if (along_x) {
+              run(i * cells + lo_cell, i * cells + hi_cell, f);
+          }
+          else {
+              for (int j = lo_cell; j <= hi_cell; j++) {
+                  run(j * cells + i, j * cells + i, f);
+              }
+          }
+      }
+  }
+};
+
+#endif
@@ -35,6 +35,8 @@
 #include <vector>
 #include <utility>
 #include <mutex>
+#include <memory>
+#include <atomic>
 
 #include <ros/ros.h>
 #include <tf2_geometry_msgs/tf2_geometry_msgs.h>
@@ -43,6 +45,12 @@
 #include <sensor_msgs/Range.h>
 #include <sensor_msgs/LaserScan.h>
 
+#include "move_smooth/obstacle_cloud.h"
+#include "move_smooth/polar_index.h"
+#include "move_smooth/obstacle_grid.h"
+#include "move_smooth/update_trigger.h"
+#include "move_smooth/clock.h"
+
 // a single sensor with current obstacles
 class RangeSensor
 {
@@ -67,20 +75,135 @@ public:
     void update(float range, ros::Time stamp);
 };
 
+/*
+ * An immutable set of obstacles, published by the sensor callbacks.
+ * Readers take a reference to the latest snapshot and can walk it
+ * without holding any lock, while the callbacks build the next one.
+ */
+class ObstacleSnapshot
+{
+public:
+  uint64_t version;
+  ros::Time stamp;
+
+  ros::Time lidar_stamp;
+  std::shared_ptr<const ObstacleCloud> lidar_points;
+  std::shared_ptr<const PolarIndex> lidar_index;
+  std::shared_ptr<const ObstacleGrid> lidar_grid;
+
+  // cone end points of the range sensors, left and right vertex of
+  // sensor i are at 2*i and 2*i+1
+  ObstacleCloud range_points;
+  std::vector<ros::Time> range_stamps;
+
+  std::shared_ptr<const ObstacleCloud> test_points;
+  ros::Time test_stamp;
+
+  ObstacleSnapshot() : version(0) {};
+
+  // Call f(x, y, n) for every run of n points no older than max_age
+  template <typename F>
+  void for_each_cloud(const ros::Time& now, const ros::Duration& max_age, F f) const
+  {
+      if (lidar_points && !lidar_points->empty() && now - lidar_stamp < max_age) {
+          f(lidar_points->x.data(), lidar_points->y.data(), lidar_points->size());
+      }
+      for_each_other_cloud(now, max_age, f);
+  }
+
+  // Like for_each_cloud, but the lidar points come from the polar index
+  // and are limited to the rings overlapping [min_radius, max_radius]
+  // around base_frame.  For queries that only depend on radius and bearing.
+  template <typename F>
+  void for_each_polar(const ros::Time& now, const ros::Duration& max_age,
+                      float min_radius, float max_radius, F f) const
+  {
+      if (lidar_index && now - lidar_stamp < max_age) {
+          lidar_index->for_each_ring(min_radius, max_radius, f);
+      }
+      for_each_other_cloud(now, max_age, f);
+  }
+
+  // Like for_each_polar, for queries over two ranges of radius, the
+  // points in both are visited once
+  template <typename F>
+  void for_each_polar(const ros::Time& now, const ros::Duration& max_age,
+                      float min_a, float max_a, float min_b, float max_b, F f) const
+  {
+      if (lidar_index && now - lidar_stamp < max_age) {
+          lidar_index->for_each_ring(min_a, max_a, min_b, max_b, f);
+      }
+      for_each_other_cloud(now, max_age, f);
+  }
+
+  // Call f(x, y) for every point no older than max_age
+  template <typename F>
+  void for_each_point(const ros::Time& now, const ros::Duration& max_age, F f) const
+  {
+      for_each_cloud(now, max_age, [&f](const float* x, const float* y, size_t n) {
+          for (size_t i = 0; i < n; i++) {
+              f(x[i], y[i]);
+          }
+      });
+  }
+
+  // Call f(x0, y0, x1, y1) for every sonar cone no older than max_age
+  template <typename F>
+  void for_each_line(const ros::Time& now, const ros::Duration& max_age, F f) const
+  {
+      for (size_t i = 0; i < range_stamps.size(); i++) {
+          if (now - range_stamps[i] < max_age) {
+              f(range_points.x[2*i], range_points.y[2*i],
+                range_points.x[2*i+1], range_points.y[2*i+1]);
+          }
+      }
+  }
+
+  // Call f(x, y, n) for the sonar and test points, for queries that
+  // handle the lidar points themselves
+  template <typename F>
+  void for_each_other_cloud(const ros::Time& now, const ros::Duration& max_age, F& f) const
+  {
+      for (size_t i = 0; i < range_stamps.size(); i++) {
+          if (now - range_stamps[i] < max_age) {
+              f(&range_points.x[2*i], &range_points.y[2*i], 2);
+          }
+      }
+      if (test_points && !test_points->empty() && now - test_stamp < max_age) {
+          f(test_points->x.data(), test_points->y.data(), test_points->size());
+      }
+  }
+};
+
 class ObstaclePoints
 {
 private:
-  // Line in polar form
-  class PolarLine
+  // Beam directions of a scanner, already rotated into base_frame,
+  // so that a range can be converted to x/y without any trig.
+  // Rebuilt only when the scan geometry changes.
+  class ScanTable
   {
   public:
-     float radius;
-     float theta;
+     float angle_min;
+     float angle_increment;
+     size_t count;
+     std::vector<float> dir_x;
+     std::vector<float> dir_y;
 
-     PolarLine(float radius, float theta);
+     ScanTable();
+     bool matches(const sensor_msgs::LaserScan& scan) const;
+     void build(const sensor_msgs::LaserScan& scan, const tf2::Vector3& normal);
   };
 
+  // Serializes the writers, readers never take it
   std::mutex points_mutex;
+
+  // Latest published snapshot, only accessed through std::atomic_load/store
+  std::shared_ptr<const ObstacleSnapshot> snapshot;
+  uint64_t snapshot_version;
+  // Snapshots are recycled once no reader holds them, so that
+  // publishing one doesn't allocate
+  std::shared_ptr<ObstacleSnapshot> snapshot_pool[3];
    
   std::string baseFrame;
 
@@ -88,23 +211,65 @@ private:
   ros::Subscriber sonar_sub;
   ros::Subscriber scan_sub;
   tf2_ros::Buffer& tf_buffer;
+  // ages the points, must outlive this
+  const Clock& clock;
    
   bool have_lidar;
   tf2::Vector3 lidar_origin;
   tf2::Vector3 lidar_normal;
-  std::vector<PolarLine> lidar_points;
+  ScanTable lidar_table;
+  // lidar points in base_frame, converted on arrival. Two buffers
+  // are kept so that a scan can be written while the previous one is
+  // still being read.
+  std::shared_ptr<ObstacleCloud> lidar_buffers[2];
+  std::shared_ptr<PolarIndex> lidar_index_buffers[2];
+  std::shared_ptr<ObstacleGrid> lidar_grid_buffers[2];
+  int lidar_current;
+  // bin sizes for the polar index
+  float polar_ring_width;
+  float polar_max_radius;
+  int polar_bearing_bins;
+  // cell size and half width of the grid
+  float grid_cell_size;
+  float grid_extent;
   ros::Time lidar_stamp;
 
   // Manually added points, used for unit testing things that
-  // use ObstaclePoints without having to go through ROS messages
-  std::vector<tf2::Vector3> test_points;
+  // use ObstaclePoints without having to go through ROS messages,
+  // they age from when the last one was added
+  std::shared_ptr<const ObstacleCloud> test_points;
+  ros::Time test_stamp;
+
+  // Notified of every new snapshot, if set
+  UpdateTrigger* trigger;
+
+  // Build a new snapshot from the current state and publish it,
+  // called with points_mutex held
+  void publish_snapshot(const ros::Time& stamp);
+
+  // Drop the references held by pooled snapshots that nobody is
+  // reading, so that the lidar buffers they point to can be reused
+  void release_idle_snapshots();
 
 public:
-  ObstaclePoints(ros::NodeHandle& nh, tf2_ros::Buffer& tf_buffer);
+  ObstaclePoints(ros::NodeHandle& nh, tf2_ros::Buffer& tf_buffer,
+                 const Clock& clock = Clock::ros_clock());
 
   void range_callback(const sensor_msgs::Range::ConstPtr &msg);
   void scan_callback(const sensor_msgs::LaserScan::ConstPtr &msg);
 
+  /*
+   * Returns the latest obstacle snapshot. This never blocks on the
+   * sensor callbacks and does not allocate.
+   *
+   */
+  std::shared_ptr<const ObstacleSnapshot> get_snapshot() const;
+
+  // Notify trigger whenever a new snapshot is published
+  void set_update_trigger(UpdateTrigger* trigger);
+
+  const Clock& get_clock() const { return clock; }
+
   /*
    * Returns a vector of all the points that were detected, filtered
    * by the maximum age.
@@ -122,7 +287,7 @@ public:
   std::vector<Line> get_lines(ros::Duration max_age);
 
   // Used for unit testing things that use ObstaclePoints 
-  // without having to go through ROS messages
+  // without having to go through ROS messages, only x and y are used
   void add_test_point(tf2::Vector3 p);
   void clear_test_points();
 
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef POLAR_INDEX_H
+#define POLAR_INDEX_H
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "move_smooth/obstacle_cloud.h"
+
+/*
+ * Polar bin index of a cloud around base_link, built when the cloud
+ * arrives.  Points are binned by radius ring and bearing, and for each
+ * occupied bin only the points with the smallest and largest bearing
+ * and the closest point are kept, stored ring by ring.  Rotation and
+ * arc queries only depend on the radius and bearing of an obstacle, so
+ * they can visit just the rings they need, with at most three points
+ * per bin whatever the lidar resolution.  Answers agree with a sweep over every point to within
+ * about the size of one bin.
+ *
+ * Points beyond the last ring are kept as they are, in an overflow
+ * ring at the end.
+ */
+class PolarIndex
+{
+public:
+  PolarIndex();
+
+  void configure(float ring_width, float max_radius, size_t bearing_bins);
+  void build(const ObstacleCloud& cloud);
+
+  // Call f(x, y, n) once with the points of all the rings that overlap
+  // [min_radius, max_radius]
+  template <typename F>
+  void for_each_ring(float min_radius, float max_radius, F f) const
+  {
+      if (points.empty() || max_radius < min_radius) {
+          return;
+      }
+      for_rings(ring_of(std::max(min_radius, 0.0f)), ring_of(max_radius), f);
+  }
+
+  // Call f(x, y, n) with the points of the rings that overlap either
+  // range, rings in both are only visited once
+  template <typename F>
+  void for_each_ring(float min_a, float max_a, float min_b, float max_b, F f) const
+  {
+      if (max_b < min_b) {
+          for_each_ring(min_a, max_a, f);
+          return;
+      }
+      if (max_a < min_a) {
+          for_each_ring(min_b, max_b, f);
+          return;
+      }
+      if (points.empty()) {
+          return;
+      }
+      size_t first_a = ring_of(std::max(min_a, 0.0f));
+      size_t last_a = ring_of(max_a);
+      size_t first_b = ring_of(std::max(min_b, 0.0f));
+      size_t last_b = ring_of(max_b);
+      if (first_b <= last_a + 1 && first_a <= last_b + 1) {
+          // One run of rings
+          for_rings(std::min(first_a, first_b), std::max(last_a, last_b), f);
+      }
+      else {
+          for_rings(first_a, last_a, f);
+          for_rings(first_b, last_b, f);
+      }
+  }
+
+  size_t size() const { return points.size(); }
+
+private:
+  struct Entry
+  {
+      uint32_t bin;
+      float radius;
+      float bearing;
+      float x;
+      float y;
+  };
+
+  float ring_width;
+  size_t rings;
+  size_t bearing_bins;
+
+  // Kept points in ring order.  Ring i is [ring_start[i], ring_start[i+1]),
+  // ring `rings` is the overflow ring.
+  ObstacleCloud points;
+  std::vector<uint32_t> ring_start;
+
+  // Sort buffer, kept to avoid allocating on every scan
+  std::vector<Entry> entries;
+
+  size_t ring_of(float radius) const
+  {
+      float ring = radius / ring_width;
+      return ring < rings ? (size_t) ring : rings;
+  }
+
+  template <typename F>
+  void for_rings(size_t first, size_t last, F& f) const
+  {
+      uint32_t begin = ring_start[first];
+      uint32_t end = ring_start[last + 1];
+      if (end > begin) {
+          f(points.x.data() + begin, points.y.data() + begin, end - begin);
+      }
+  }
+};
+
+#endif
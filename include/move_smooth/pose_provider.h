@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef POSE_PROVIDER_H
+#define POSE_PROVIDER_H
+
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+#include <tf2/LinearMath/Transform.h>
+#include <tf2_ros/buffer.h>
+#include <nav_msgs/Odometry.h>
+
+#include "move_smooth/latest_value.h"
+#include "move_smooth/update_trigger.h"
+#include "move_smooth/clock.h"
+
+/*
+ * Source of robot poses and goal transforms for the control loops.
+ *
+ * Frame ids are normalised once, when they are given to the provider,
+ * rather than on every lookup.  Goals are transformed into the driving
+ * frame once and cached, so following a goal needs at most one TF
+ * lookup per cycle, for the robot pose.  With use_odometry set, the
+ * pose in odom_frame is read straight from the odometry messages
+ * through a lock-free slot, with no TF lookup at all.
+ *
+ * With fuse_odometry set, the pose in any other frame, such as map, is
+ * the latest correction from that frame to odom_frame chained with the
+ * latest pose in odom_frame.  This gives a fresh pose every cycle even
+ * though localization is slow and delayed.  It defaults to use_odometry,
+ * so that the pose still takes a single lookup per cycle.
+ */
+class PoseProvider
+{
+  struct OdomPose
+  {
+      ros::Time stamp;
+      tf2::Transform pose;     // base_frame in odom_frame
+  };
+
+  // A goal transformed into a frame, cached by value
+  struct CachedGoal
+  {
+      bool valid;
+      std::string goal_frame;  // as given, before resolving
+      tf2::Transform goal;
+      std::string frame;
+      tf2::Transform in_frame;
+  };
+
+  tf2_ros::Buffer& tf_buffer;
+  const Clock& clock;
+  std::string base_frame;
+  std::string odom_frame;
+
+  bool use_odometry;
+  bool fuse_odometry;
+  ros::Duration odom_timeout;
+  ros::Subscriber odom_sub;
+  LatestValue<OdomPose> odom;
+  UpdateTrigger* trigger;
+
+  std::vector<CachedGoal> goals;
+  size_t next_goal;
+
+  void odom_callback(const nav_msgs::Odometry::ConstPtr& msg);
+  bool lookup(const std::string& from, const std::string& to,
+              tf2::Transform& tf);
+  bool base_in_odom(tf2::Transform& pose);
+
+public:
+  /*
+   * If trigger is given it is notified of every odometry message,
+   * which subscribes to odometry even without use_odometry.
+   */
+  PoseProvider(ros::NodeHandle& nh, tf2_ros::Buffer& tf_buffer,
+               UpdateTrigger* trigger = nullptr,
+               const Clock& clock = Clock::ros_clock());
+
+  // Strip the leading '/' that tf2 doesn't accept
+  static std::string resolve(const std::string& frame);
+
+  const std::string& get_base_frame() const { return base_frame; }
+
+  // Number of goal transforms that are cached, at least one for each
+  // goal that the control loop looks at
+  void set_goal_cache_size(size_t size);
+
+  // Forget the cached goals, so that a goal sent again is looked up
+  // again.  Must only be called from the thread that transforms goals.
+  void clear_goals();
+
+  /*
+   * The transform that takes `from` coordinates to `to` coordinates,
+   * so get_transform(driving, base_frame, tf) gives the driving frame
+   * in base_frame.  Returns false if it is not available.  Must only
+   * be called from one thread.
+   */
+  bool get_transform(const std::string& from, const std::string& to,
+                     tf2::Transform& tf);
+
+  /*
+   * The goal, given in goal_frame, in frame.  Looked up once for each
+   * goal and then served from the cache until clear_goals().  Must only
+   * be called from one thread.
+   */
+  bool transform_goal(const std::string& goal_frame, const tf2::Transform& goal,
+                      const std::string& frame, tf2::Transform& out);
+};
+
+#endif
@@ -41,6 +41,7 @@
 #include <ros/ros.h>
 
 #include <condition_variable>
+#include <deque>
 #include <string>
 #include <thread>
 #include <atomic>
@@ -63,6 +64,9 @@ public:
 
     boost::shared_ptr<const Goal> acceptNewGoal();
     boost::shared_ptr<const Goal> getQueuedGoalState();
+    boost::shared_ptr<const Goal> getQueuedGoal(size_t index);
+    size_t getQueueLength();
+    void setMaxQueueLength(size_t length);
     bool isNewGoalAvailable();
     bool isPreemptRequested();
     bool isActive();
@@ -77,19 +81,34 @@ private:
     void preemptCallback(GoalHandle preempt);
 
     void executeLoop();
+    boost::shared_ptr<const Goal> acceptNextGoal(std::unique_lock<std::mutex>& lk);
 
     ros::NodeHandle n_;
 
     std::shared_ptr<ActionServer<ActionSpec>> as;
 
-    GoalHandle current_goal, next_goal;
+    struct QueuedGoal {
+        GoalHandle handle;
+        ros::WallTime received;
+    };
 
-    bool new_goal_, preempt_request_, new_goal_preempt_request_;
+    // Pending goals, oldest first. When the queue is full the oldest
+    // pending goal is bumped out by a new one.
+    GoalHandle current_goal;
+    std::deque<QueuedGoal> queued_goals;
+    size_t max_queue_length;
 
-    std::recursive_mutex lock;
+    // Copies of the state that the execute callback polls, so that it
+    // can be read without taking the lock
+    std::atomic<size_t> queue_length;
+    std::atomic<bool> preempt_request_;
+
+    // Guards the goals, never held while calling out of this class
+    // other than to the goal handles
+    std::mutex lock;
 
     ExecuteCallback execute_callback;
-    std::condition_variable_any execute_condition;
+    std::condition_variable execute_condition;
     std::thread *execute_thread;
 
     std::atomic<bool> need_to_terminate;
@@ -38,6 +38,8 @@
 #define QUEUED_ACTION_SERVER_IMP_H_
 
 #include <ros/ros.h>
+#include "move_smooth/trace.h"
+#include <algorithm>
 #include <chrono>
 #include <string>
 
@@ -46,9 +48,9 @@ namespace actionlib {
 template <class ActionSpec>
 QueuedActionServer<ActionSpec>::QueuedActionServer(std::string name,
                                                    ExecuteCallback execute_callback)
-    : new_goal_(false),
+    : max_queue_length(1),
+      queue_length(0),
       preempt_request_(false),
-      new_goal_preempt_request_(false),
       execute_callback(execute_callback),
       execute_thread(NULL),
       need_to_terminate(false) {
@@ -66,9 +68,9 @@ template <class ActionSpec>
 QueuedActionServer<ActionSpec>::QueuedActionServer(ros::NodeHandle n, std::string name,
                                                    ExecuteCallback execute_callback)
     : n_(n),
-      new_goal_(false),
+      max_queue_length(1),
+      queue_length(0),
       preempt_request_(false),
-      new_goal_preempt_request_(false),
       execute_callback(execute_callback),
       execute_thread(NULL),
       need_to_terminate(false) {
@@ -92,7 +94,11 @@ QueuedActionServer<ActionSpec>::~QueuedActionServer() {
 template <class ActionSpec>
 void QueuedActionServer<ActionSpec>::shutdown() {
     if (execute_callback) {
-        need_to_terminate = true;
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            need_to_terminate = true;
+        }
+        execute_condition.notify_all();
 
         assert(execute_thread);
         if (execute_thread) {
@@ -106,39 +112,71 @@ void QueuedActionServer<ActionSpec>::shutdown() {
 template <class ActionSpec>
 boost::shared_ptr<const typename QueuedActionServer<ActionSpec>::Goal>
 QueuedActionServer<ActionSpec>::acceptNewGoal() {
-    std::lock_guard<std::recursive_mutex> lk(lock);
+    std::unique_lock<std::mutex> lk(lock);
+    return acceptNextGoal(lk);
+}
 
-    if (!new_goal_ || !next_goal.getGoal()) {
+// Called with the lock held, which is released before the goal status
+// is set, see setSucceeded
+template <class ActionSpec>
+boost::shared_ptr<const typename QueuedActionServer<ActionSpec>::Goal>
+QueuedActionServer<ActionSpec>::acceptNextGoal(std::unique_lock<std::mutex>& lk) {
+    if (queued_goals.empty()) {
         ROS_ERROR_NAMED("actionlib",
                         "Attempting to accept the next goal when a new goal is not available");
         return boost::shared_ptr<const Goal>();
     }
 
-    ROS_DEBUG_NAMED("actionlib", "Accepting a new goal");
+    ROS_DEBUG_NAMED("actionlib", "Accepting a new goal, %.1f us after it was received",
+                    (ros::WallTime::now() - queued_goals.front().received).toSec() * 1e6);
 
     // accept the next goal
-    current_goal = next_goal;
-    new_goal_ = false;
+    current_goal = queued_goals.front().handle;
+    queued_goals.pop_front();
+    queue_length = queued_goals.size();
 
-    // set preempt to request to equal the preempt state of the new goal
-    preempt_request_ = new_goal_preempt_request_;
-    new_goal_preempt_request_ = false;
+    // queued goals that are preempted are removed from the queue
+    preempt_request_ = false;
+
+    GoalHandle goal = current_goal;
+    lk.unlock();
 
     // set the status of the current goal to be active
-    current_goal.setAccepted("This goal has been accepted by the simple action server");
+    goal.setAccepted("This goal has been accepted by the simple action server");
 
-    return current_goal.getGoal();
+    return goal.getGoal();
 }
 
 template <class ActionSpec>
 boost::shared_ptr<const typename QueuedActionServer<ActionSpec>::Goal>
 QueuedActionServer<ActionSpec>::getQueuedGoalState() {
-    return next_goal.getGoal();
+    return getQueuedGoal(0);
+}
+
+template <class ActionSpec>
+boost::shared_ptr<const typename QueuedActionServer<ActionSpec>::Goal>
+QueuedActionServer<ActionSpec>::getQueuedGoal(size_t index) {
+    std::lock_guard<std::mutex> lk(lock);
+    if (index >= queued_goals.size()) {
+        return boost::shared_ptr<const Goal>();
+    }
+    return queued_goals[index].handle.getGoal();
+}
+
+template <class ActionSpec>
+size_t QueuedActionServer<ActionSpec>::getQueueLength() {
+    return queue_length;
+}
+
+template <class ActionSpec>
+void QueuedActionServer<ActionSpec>::setMaxQueueLength(size_t length) {
+    std::lock_guard<std::mutex> lk(lock);
+    max_queue_length = std::max<size_t>(length, 1);
 }
 
 template <class ActionSpec>
 bool QueuedActionServer<ActionSpec>::isNewGoalAvailable() {
-    return new_goal_;
+    return queue_length > 0;
 }
 
 
@@ -149,69 +187,99 @@ bool QueuedActionServer<ActionSpec>::isPreemptRequested() {
 
 template <class ActionSpec>
 bool QueuedActionServer<ActionSpec>::isActive() {
-    if (!current_goal.getGoal()) {
+    GoalHandle goal;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        goal = current_goal;
+    }
+    if (!goal.getGoal()) {
         return false;
     }
-    unsigned int status = current_goal.getGoalStatus().status;
+    unsigned int status = goal.getGoalStatus().status;
     return status == actionlib_msgs::GoalStatus::ACTIVE ||
            status == actionlib_msgs::GoalStatus::PREEMPTING;
 }
 
+// The goal handles take the action server's lock, which is held when it
+// calls goalCallback and preemptCallback, so the status is set without
+// holding our lock
+
 template <class ActionSpec>
 void QueuedActionServer<ActionSpec>::setSucceeded(const Result& result, const std::string& text) {
-    std::lock_guard<std::recursive_mutex> lk(lock);
+    GoalHandle goal;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        goal = current_goal;
+    }
     ROS_DEBUG_NAMED("actionlib", "Setting the current goal as succeeded");
-    current_goal.setSucceeded(result, text);
+    goal.setSucceeded(result, text);
 }
 
 template <class ActionSpec>
 void QueuedActionServer<ActionSpec>::setAborted(const Result& result, const std::string& text) {
-    std::lock_guard<std::recursive_mutex> lk(lock);
+    GoalHandle goal;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        goal = current_goal;
+    }
     ROS_DEBUG_NAMED("actionlib", "Setting the current goal as aborted");
-    current_goal.setAborted(result, text);
+    goal.setAborted(result, text);
 }
 
 template <class ActionSpec>
 void QueuedActionServer<ActionSpec>::setPreempted(const Result& result, const std::string& text) {
-    std::lock_guard<std::recursive_mutex> lk(lock);
+    GoalHandle goal;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        goal = current_goal;
+    }
     ROS_DEBUG_NAMED("actionlib", "Setting the current goal as canceled");
-    current_goal.setCanceled(result, text);
+    goal.setCanceled(result, text);
 }
 
 template <class ActionSpec>
 void QueuedActionServer<ActionSpec>::goalCallback(GoalHandle goal) {
-    std::lock_guard<std::recursive_mutex> lk(lock);
+    trace::Scope scope("action goal");
+    ros::WallTime received = ros::WallTime::now();
     ROS_DEBUG_NAMED("actionlib", "A new goal has been recieved by the single goal action server");
 
-    // check that the timestamp is past or equal to that of the current goal and the next goal
-    if ((!current_goal.getGoal() || goal.getGoalID().stamp >= current_goal.getGoalID().stamp) &&
-        (!next_goal.getGoal() || goal.getGoalID().stamp >= next_goal.getGoalID().stamp)) {
+    {
+        std::lock_guard<std::mutex> lk(lock);
+
+        // check that the timestamp is past or equal to that of the current goal and the queued goals
+        if ((current_goal.getGoal() && goal.getGoalID().stamp < current_goal.getGoalID().stamp) ||
+            (!queued_goals.empty() && goal.getGoalID().stamp < queued_goals.back().handle.getGoalID().stamp)) {
+            // This is an old goal, we are going to reject it
+            goal.setRejected(
+                Result(),
+                "This goal was rejected because another goal there are newer goals in the queue");
+            return;
+        }
 
-        // if next_goal has not been accepted already... its going to get bumped, but we need to let
+        // if the queue is full the oldest pending goal gets bumped, but we need to let
         // the client know we're preempting
-        if (next_goal.getGoal() && (!current_goal.getGoal() || next_goal != current_goal)) {
-            next_goal.setCanceled(Result(),
-                                  "This goal was canceled because another goal was received"
-                                  "bumping this one out of the queue");
+        while (queued_goals.size() >= max_queue_length) {
+            queued_goals.front().handle.setCanceled(Result(),
+                                                    "This goal was canceled because another goal was received "
+                                                    "bumping this one out of the queue");
+            queued_goals.pop_front();
         }
 
-        next_goal = goal;
-        new_goal_ = true;
-        new_goal_preempt_request_ = false;
-
-        // Trigger runLoop to call execute()
-        execute_condition.notify_all();
-    } else {
-        // This is an old goal, we are going to reject it
-        goal.setRejected(
-            Result(),
-            "This goal was rejected because another goal there are newer goals in the queue");
+        QueuedGoal queued;
+        queued.handle = goal;
+        queued.received = received;
+        queued_goals.push_back(queued);
+        queue_length = queued_goals.size();
     }
+
+    // Wake up executeLoop to call execute()
+    execute_condition.notify_one();
 }
 
 template <class ActionSpec>
 void QueuedActionServer<ActionSpec>::preemptCallback(GoalHandle preempt) {
-    std::lock_guard<std::recursive_mutex> lk(lock);
+    trace::Scope scope("action preempt");
+    std::lock_guard<std::mutex> lk(lock);
     ROS_DEBUG_NAMED("actionlib", "A preempt has been received by the QueuedActionServer");
 
     // if the preempt is for the current goal, then we'll set the preemptRequest flag and call the
@@ -222,55 +290,57 @@ void QueuedActionServer<ActionSpec>::preemptCallback(GoalHandle preempt) {
             "Setting preempt_request bit for the current goal to TRUE");
         preempt_request_ = true;
 
-    } else if (preempt == next_goal) {
-        // if the preempt applies to the next goal, we'll set the preempt bit for that
-        ROS_DEBUG_NAMED("actionlib", "Setting preempt request bit for the next goal to TRUE");
-        new_goal_preempt_request_ = true;
+    } else {
+        // if the preempt applies to a queued goal, it is canceled and dropped from the queue
+        for (auto it = queued_goals.begin(); it != queued_goals.end(); ++it) {
+            if (preempt == it->handle) {
+                ROS_DEBUG_NAMED("actionlib", "Canceling a queued goal");
+                it->handle.setCanceled(Result(), "This goal was canceled while it was queued");
+                queued_goals.erase(it);
+                queue_length = queued_goals.size();
+                break;
+            }
+        }
     }
 }
 
 template <class ActionSpec>
 void QueuedActionServer<ActionSpec>::executeLoop() {
-    ros::Duration loop_duration = ros::Duration().fromSec(.1);
+    // Goals wake the loop up straight away, the timeout is only there to
+    // notice ROS shutting down
+    const std::chrono::seconds shutdown_check(1);
+    trace::set_thread_name("execute");
 
     while (n_.ok()) {
-        if (need_to_terminate) {
-            break;
+        GoalConstPtr goal;
+        {
+            std::unique_lock<std::mutex> lk(lock);
+            if (!execute_condition.wait_for(lk, shutdown_check, [this] {
+                    return need_to_terminate || !this->queued_goals.empty(); })) {
+                continue;
+            }
+            if (need_to_terminate) {
+                break;
+            }
+            goal = acceptNextGoal(lk);
         }
 
-        std::unique_lock<std::recursive_mutex> lk(lock);
-        execute_condition.wait_for(lk, std::chrono::duration<double>(loop_duration.toSec()),
-                                   [this] { return this->new_goal_; });
+        ROS_FATAL_COND(!execute_callback,
+                       "execute_callback must exist. This is a bug in QueuedActionServer");
 
-        if (isActive()) {
-            ROS_ERROR_NAMED("actionlib", "Should never reach this code with an active goal");
-        } else if (isNewGoalAvailable()) {
-            GoalConstPtr goal = acceptNewGoal();
-
-            ROS_FATAL_COND(!execute_callback,
-                           "execute_callback must exist. This is a bug in QueuedActionServer");
-
-            {
-                // Make sure we're not locked when we call execute, relock in exception safe way
-                lk.unlock();
-                try {
-                    execute_callback(goal);
-                } catch (...) {
-                    lk.lock();
-                    throw;
-                }
-                lk.lock();
-            }
+        {
+            trace::Scope scope("execute");
+            execute_callback(goal);
+        }
 
-            if (isActive()) {
-                ROS_WARN_NAMED("actionlib",
-                               "Your executeCallback did not set the goal to a terminal status.\n"
-                               "This is a bug in your ActionServer implementation. Fix your code!\n"
-                               "For now, the ActionServer will set this goal to aborted");
-                setAborted(Result(),
-                           "This goal was aborted by the simple action server. The user should "
-                           "have set a terminal status on this goal and did not");
-            }
+        if (isActive()) {
+            ROS_WARN_NAMED("actionlib",
+                           "Your executeCallback did not set the goal to a terminal status.\n"
+                           "This is a bug in your ActionServer implementation. Fix your code!\n"
+                           "For now, the ActionServer will set this goal to aborted");
+            setAborted(Result(),
+                       "This goal was aborted by the simple action server. The user should "
+                       "have set a terminal status on this goal and did not");
         }
     }
 }
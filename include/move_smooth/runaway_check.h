@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef RUNAWAY_CHECK_H
+#define RUNAWAY_CHECK_H
+
+#include <ros/ros.h>
+
+#include "move_smooth/clock.h"
+
+/*
+ * Notices a robot that keeps driving away from its goal.  Localization
+ * is imperfect, so the robot only counts as moving away while the goal
+ * is behind it and the distance has grown by more than the tolerance
+ * since the last update, and only a runaway if that has lasted for the
+ * whole timeout on the clock.
+ */
+class RunawayCheck
+{
+  const Clock& clock;
+  double tolerance;
+  ros::Duration timeout;
+  double previous_distance;
+  ros::Time last_progress;
+
+public:
+  explicit RunawayCheck(const Clock& clock, double tolerance = 0.02);
+
+  // Start checking a goal that is distance away
+  void start(double distance, const ros::Duration& timeout);
+
+  // The robot is being held still, which is not running away
+  void hold();
+
+  // Returns true if the robot has been moving away from the goal for
+  // longer than the timeout, with the goal at distance and bearing angle
+  bool update(double distance, double angle);
+};
+
+#endif
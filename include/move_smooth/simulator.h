@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <ros/ros.h>
+#include <actionlib/client/simple_action_client.h>
+#include <geometry_msgs/Twist.h>
+#include <move_base_msgs/MoveBaseAction.h>
+#include <sensor_msgs/LaserScan.h>
+#include <tf2_ros/static_transform_broadcaster.h>
+#include <tf2_ros/transform_broadcaster.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Headless simulation for move_smooth
+ *
+ * Stands in for the robot and its sensors so that move_smooth can be run
+ * through whole missions on a plain Linux box.  A unicycle is driven by
+ * /cmd_vel in a world of 2D polygons; odometry, TF, a lidar scan and
+ * optionally sonars are generated from it, and the simulated time is
+ * published on /clock (run with /use_sim_time).
+ *
+ * The simulation runs in lock step with move_smooth: after each step it
+ * waits for the next command, up to command_timeout of wall time, so it
+ * runs as fast as move_smooth can keep up.  Goals are sent to the
+ * move_base action one after the other, and for each the mission time,
+ * the minimum clearance between the robot and the world and the wall
+ * time per step are reported.  The loop timings of move_smooth are
+ * printed at the end from its dump_stats service.
+ *
+ * The exit status is non-zero if a goal did not succeed or the robot
+ * got closer than min_clearance to an obstacle, see launch/simulate.launch
+ * and test/simulate.test.
+ */
+
+typedef actionlib::SimpleActionClient<move_base_msgs::MoveBaseAction> MoveBaseClient;
+
+struct Point
+{
+  double x, y;
+};
+
+typedef std::vector<Point> Polygon;
+
+struct Sonar
+{
+  Point position;
+  double yaw;
+};
+
+struct Goal
+{
+  Point position;
+  double yaw;
+};
+
+// How a goal went
+struct GoalResult
+{
+  bool succeeded;
+  double mission_time;     // simulated seconds
+  double wall_time;        // seconds
+  double clearance;        // closest the robot got to the world
+  uint64_t steps;
+  uint64_t missed;         // steps without a command in time
+  double accept_time;      // wall seconds from sending the goal to it leaving pending
+};
+
+class Simulator
+{
+  ros::NodeHandle nh;
+  ros::Publisher clock_pub;
+  ros::Publisher odom_pub;
+  ros::Publisher scan_pub;
+  ros::Publisher sonar_pub;
+  ros::Subscriber cmd_sub;
+  tf2_ros::TransformBroadcaster tf_broadcaster;
+  tf2_ros::StaticTransformBroadcaster static_broadcaster;
+
+  std::vector<Polygon> world;
+  std::vector<Sonar> sonars;
+  std::vector<Goal> goals;
+
+  std::string map_frame;
+  std::string odom_frame;
+  std::string base_frame;
+  std::string laser_frame;
+
+  // Simulation
+  ros::Time now;
+  double step;
+  int sensor_steps;
+  double command_timeout;
+  double goal_timeout;
+  double realtime_factor;
+  double robot_radius;
+  double min_clearance;
+
+  // Robot state
+  Point position;
+  double yaw;
+  double linear;
+  double angular;
+
+  // Sensors
+  double laser_x;
+  int scan_beams;
+  double scan_range;
+  double sonar_fov;
+  double sonar_range;
+  sensor_msgs::LaserScan scan;
+
+  // Latest command, and how many have been received
+  std::mutex cmd_mutex;
+  std::condition_variable cmd_condition;
+  uint64_t cmd_count;
+  double cmd_linear;
+  double cmd_angular;
+
+  void cmd_callback(const geometry_msgs::Twist::ConstPtr& msg);
+  bool wait_for_command(uint64_t seen);
+
+  void advance(double dt);
+  double cast(const Point& origin, double angle, double max_range) const;
+  double clearance() const;
+  void publish_transforms();
+  void publish_state(bool sensors);
+
+  std::vector<GoalResult> results;
+
+  bool load();
+
+public:
+  Simulator();
+
+  bool run_goal(MoveBaseClient& client, size_t index, const Goal& goal);
+  // Drive to the goals in turn, returns 0 if they all succeeded, 1 if
+  // any failed and 2 if the parameters are malformed, as an exit status
+  int run();
+
+  // One for each goal run so far
+  const std::vector<GoalResult>& get_results() const { return results; }
+
+  // The latest command, returns how many have been received
+  uint64_t get_command(double& linear, double& angular);
+};
+
+#endif
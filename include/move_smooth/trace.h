@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Opt-in tracing of callbacks, control cycles and collision checks, for
+ * working out which thread held things up.  Each thread records
+ * complete events (a name, start and duration) into its own ring
+ * buffer, so recording takes no locks and, once a thread has its
+ * buffer, no allocation.  When a buffer is full the oldest events are
+ * overwritten.  The buffers are written out as a Chrome trace JSON
+ * file, which chrome://tracing and Perfetto open with one lane for each
+ * thread.
+ *
+ * Until start() is called recording is a single relaxed load.
+ */
+namespace trace
+{
+
+// Start recording, with room for capacity events per thread
+void start(size_t capacity);
+
+bool enabled();
+
+// Name the calling thread's lane in the trace
+void set_thread_name(const char* name);
+
+// Write the events recorded so far, returns false if the file can't be
+// written.  Events recorded while writing may be missing or garbled.
+bool write(const std::string& path);
+
+// Records an event covering its lifetime.  The name must be a string
+// literal, or live as long as the trace.
+class Scope
+{
+  const char* name;
+  uint64_t start;
+
+public:
+  explicit Scope(const char* name);
+  ~Scope();
+};
+
+}
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#ifndef UPDATE_TRIGGER_H
+#define UPDATE_TRIGGER_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+
+#include <ros/ros.h>
+
+#include "move_smooth/clock.h"
+
+/*
+ * Counts the arrivals of new sensor data, so that the control loops
+ * can run a step as soon as something has changed instead of at a
+ * fixed rate.  notify() is called by the sensor callbacks with the
+ * stamp of the data, on whichever thread runs them, and wakes up any
+ * thread blocked in wait().
+ */
+class UpdateTrigger
+{
+  std::atomic<uint64_t> updates;
+  std::mutex mutex;
+  std::condition_variable updated;
+  ros::Time latest_stamp;
+
+public:
+  UpdateTrigger() : updates(0) {}
+
+  void notify(const ros::Time& stamp);
+
+  // Number of updates so far, compare with an earlier value to see
+  // whether anything new has arrived
+  uint64_t count() const { return updates.load(); }
+
+  // Stamp of the newest data
+  ros::Time stamp();
+
+  // Block until count() differs from seen or timeout has passed,
+  // returns true if there was an update
+  bool wait(uint64_t seen, const ros::WallDuration& timeout);
+};
+
+/*
+ * Sensor to command latency, the time from the stamp of the newest
+ * sensor data to the command being sent, on the clock the stamps come
+ * from.  Summarised in the log every report period of wall time.
+ */
+class LatencyMonitor
+{
+  const char* name;
+  const Clock& clock;
+  ros::WallDuration report_period;
+  ros::WallTime last_report;
+  uint64_t samples;
+  double total;
+  double max;
+
+public:
+  LatencyMonitor(const char* name, double report_period,
+                 const Clock& clock = Clock::ros_clock());
+
+  void record(const ros::Time& sensor_stamp);
+};
+
+#endif
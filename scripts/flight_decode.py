@@ -0,0 +1,148 @@
+#!/usr/bin/python
+
+"""
+Copyright (c) 2020, Ubiquity Robotics
+All rights reserved.
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of display_node nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+"""
+
+"""
+Decoder for the move_smooth flight recorder
+
+move_smooth keeps its last few thousand commands, with the pose,
+remaining distance and angle and clearance they were computed from, and
+writes them to ~flight_recorder_file (/tmp/move_smooth_flight.bin) when
+a goal aborts or when it is sent SIGUSR1:
+
+    pkill -USR1 move_smooth
+
+This prints the records as a table, or as CSV with --csv.  Times are
+relative to the first record unless --absolute is given.
+"""
+
+import getopt, sys
+import struct
+
+HEADER = struct.Struct('<8sIIIId128s')
+RECORD = struct.Struct('<dIBBH14f')
+
+FIELDS = ['stamp', 'goal', 'mode', 'flags',
+          'x', 'y', 'yaw', 'distance', 'angle',
+          'forward', 'rear', 'left', 'right', 'rotate_left', 'rotate_right',
+          'clearance_age', 'linear', 'angular']
+
+MODES = {0: 'idle', 1: 'rotate', 2: 'follow'}
+
+
+def printUsage():
+    print("""flight_decode.py [options] [file]
+    -h --help       - This help menu
+    -c --csv        - Print CSV rather than a table
+    -a --absolute   - Print ROS times rather than times from the first record
+    -n --last N     - Only print the last N records""")
+
+
+def flagNames(flags):
+    names = []
+    if flags & 1:
+        names.append('stop')
+    if flags & 2:
+        names.append('obstacle')
+    return '|'.join(names) or '-'
+
+
+def decode(data):
+    if len(data) < HEADER.size:
+        raise ValueError('file is too short for a flight record')
+    magic, version, recordSize, count, goal, stamp, reason = HEADER.unpack_from(data)
+    if magic != b'MSFLIGHT':
+        raise ValueError('not a move_smooth flight record')
+    if version != 1 or recordSize != RECORD.size:
+        raise ValueError('flight record version %d is not supported' % version)
+    count = min(count, (len(data) - HEADER.size) // RECORD.size)
+
+    records = []
+    for i in range(count):
+        values = RECORD.unpack_from(data, HEADER.size + i * RECORD.size)
+        # drop the reserved field
+        records.append(dict(zip(FIELDS, values[:4] + values[5:])))
+    header = {'goal': goal, 'stamp': stamp,
+              'reason': reason.split(b'\0', 1)[0].decode('utf-8', 'replace')}
+    return header, records
+
+
+def main():
+    csv = False
+    absolute = False
+    last = None
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], 'hcan:', \
+            ['help', 'csv', 'absolute', 'last='])
+    except getopt.GetoptError as err:
+        print(str(err))
+        printUsage()
+        sys.exit(2)
+    for opt, arg in opts:
+        if opt in ('-h', '--help'):
+            printUsage()
+            sys.exit(0)
+        elif opt in ('-c', '--csv'):
+            csv = True
+        elif opt in ('-a', '--absolute'):
+            absolute = True
+        elif opt in ('-n', '--last'):
+            last = int(arg)
+
+    path = args[0] if args else '/tmp/move_smooth_flight.bin'
+    with open(path, 'rb') as f:
+        try:
+            header, records = decode(f.read())
+        except ValueError as err:
+            print('%s: %s' % (path, err))
+            sys.exit(1)
+
+    start = records[0]['stamp'] if records and not absolute else 0.0
+    if last is not None:
+        records = records[-last:]
+
+    if csv:
+        print(','.join(FIELDS))
+        for r in records:
+            values = [r['stamp'] - start] + [r[k] for k in FIELDS[1:]]
+            print(','.join('%.9g' % v for v in values))
+        return
+
+    print('Goal %d: %s' % (header['goal'], header['reason']))
+    print('%d records, written at %.3f' % (len(records), header['stamp']))
+    print('%10s %4s %6s %-13s %7s %7s %7s %7s %7s %6s %6s %6s %6s %6s %6s %6s %6s' % \
+        ('time', 'goal', 'mode', 'flags', 'x', 'y', 'yaw', 'dist', 'angle',
+         'fwd', 'rear', 'left', 'right', 'rot_l', 'rot_r', 'v', 'w'))
+    for r in records:
+        print('%10.3f %4d %6s %-13s %7.3f %7.3f %7.3f %7.3f %7.3f %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f %6.3f %6.3f' % \
+            (r['stamp'] - start, r['goal'], MODES.get(r['mode'], str(r['mode'])),
+             flagNames(r['flags']), r['x'], r['y'], r['yaw'], r['distance'], r['angle'],
+             r['forward'], r['rear'], r['left'], r['right'],
+             r['rotate_left'], r['rotate_right'], r['linear'], r['angular']))
+
+
+if __name__ == "__main__":
+    main()
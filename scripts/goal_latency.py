@@ -0,0 +1,171 @@
+#!/usr/bin/python
+
+"""
+Copyright (c) 2020, Ubiquity Robotics
+All rights reserved.
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+* Neither the name of display_node nor the names of its
+  contributors may be used to endorse or promote products derived from
+  this software without specific prior written permission.
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+"""
+
+"""
+Benchmark for goal handoff in move_smooth
+
+Fires goals at the move_base action server at a fixed rate and reports
+how long each one takes to become active, and to finish.  By default the
+goals are at the origin of the base frame, so move_smooth accepts them
+and aborts them straight away without moving the robot.  With --preempt
+the goals are ahead of the robot and are canceled as soon as they are
+active, which measures preemption; only do that on a simulated robot.
+
+The times include the round trip over ROS topics.  The time from a goal
+arriving in move_smooth to it being handed to executeAction is logged at
+debug level by the actionlib logger.
+"""
+
+import getopt, sys
+import threading
+
+import rospy
+import actionlib
+from   actionlib_msgs.msg import GoalStatus
+from   move_base_msgs.msg import MoveBaseAction, MoveBaseGoal
+
+
+def printUsage():
+    print """-h --help       - This help menu
+    -n --count      - Number of goals to send, default 200
+    -r --rate       - Goals per second, default 50
+    -f --frame      - Frame of the goals, default base_link
+    -p --preempt    - Send goals 1m ahead and cancel them once active"""
+
+
+def percentile(values, p):
+    values = sorted(values)
+    if not values:
+        return float('nan')
+    return values[min(len(values) - 1, int(p * len(values)))]
+
+
+class GoalLatency:
+
+    def __init__(self):
+        rospy.init_node('goal_latency')
+
+        self.count = 200
+        self.rate = 50.0
+        self.frame = 'base_link'
+        self.preempt = False
+
+        try:
+            opts, args = getopt.getopt(sys.argv[1:], 'hn:r:f:p', \
+                ['help', 'count=', 'rate=', 'frame=', 'preempt'])
+        except getopt.GetoptError as err:
+            print "Error in recognized options"
+            printUsage()
+            sys.exit(2)
+
+        for o, a in opts:
+            if o in ("-h", "--help"):
+                printUsage()
+                sys.exit(2)
+            elif o in ("-n", "--count"):
+                self.count = int(a)
+            elif o in ("-r", "--rate"):
+                self.rate = float(a)
+            elif o in ("-f", "--frame"):
+                self.frame = a
+            elif o in ("-p", "--preempt"):
+                self.preempt = True
+
+        self.lock = threading.RLock()
+        self.sent = {}
+        self.active = {}
+        self.canceled = {}
+        self.done = {}
+        self.handles = []
+
+    def transition(self, handle):
+        now = rospy.get_rostime()
+        status = handle.get_goal_status()
+        with self.lock:
+            index = self.handles.index(handle) if handle in self.handles else None
+            if index is None:
+                return
+            if status == GoalStatus.ACTIVE and index not in self.active:
+                self.active[index] = now
+                if self.preempt:
+                    self.canceled[index] = rospy.get_rostime()
+                    handle.cancel()
+            elif handle.get_comm_state() == actionlib.CommState.DONE and \
+                 index not in self.done:
+                self.done[index] = (now, status)
+
+    def makeGoal(self):
+        goal = MoveBaseGoal()
+        goal.target_pose.header.frame_id = self.frame
+        goal.target_pose.header.stamp = rospy.Time.now()
+        goal.target_pose.pose.position.x = 1.0 if self.preempt else 0.0
+        goal.target_pose.pose.orientation.w = 1.0
+        return goal
+
+    def run(self):
+        client = actionlib.ActionClient('move_base', MoveBaseAction)
+        client.wait_for_server()
+
+        r = rospy.Rate(self.rate)
+        for i in range(self.count):
+            if rospy.is_shutdown():
+                return
+            with self.lock:
+                self.sent[i] = rospy.get_rostime()
+                self.handles.append(client.send_goal(self.makeGoal(),
+                                                     transition_cb=self.transition))
+            r.sleep()
+
+        # wait for the last goals to finish
+        timeout = rospy.get_rostime() + rospy.Duration(5.0)
+        while len(self.done) < self.count and rospy.get_rostime() < timeout:
+            rospy.sleep(0.05)
+
+        self.report()
+
+    def report(self):
+        def summary(name, values):
+            values = [v.to_sec() * 1000.0 for v in values]
+            print "%-10s n %4d  median %8.3f ms  p90 %8.3f ms  p99 %8.3f ms  max %8.3f ms" \
+                  % (name, len(values), percentile(values, 0.5), percentile(values, 0.9),
+                     percentile(values, 0.99), max(values) if values else float('nan'))
+
+        with self.lock:
+            summary("accept", [self.active[i] - self.sent[i] for i in self.active])
+            summary("finish", [self.done[i][0] - self.sent[i] for i in self.done])
+            if self.preempt:
+                summary("preempt", [self.done[i][0] - self.canceled[i]
+                                    for i in self.done if i in self.canceled])
+            statuses = {}
+            for i in self.done:
+                statuses[self.done[i][1]] = statuses.get(self.done[i][1], 0) + 1
+            print "Final states: %s, %d goals did not finish" \
+                  % (statuses, self.count - len(self.done))
+
+
+if __name__ == "__main__":
+    GoalLatency().run()
@@ -55,6 +55,9 @@ def printUsage():
                       box          A square box
                       octagon      An octagon pattern
                       figure8      A figure 8 dual octagon
+    -q --queue      - Keep this many goals sent ahead to move_smooth rather
+                      than waiting for each one, needs goal_queue_length
+                      set to at least one less than this
     -s --scale      - A different scale for the pattern 
     -x --offsetX    - An offset for X map placement of the pattern 
     -y --offsetY    - An offset for Y map placement of the pattern """
@@ -134,6 +137,8 @@ class Controller:
        self.waitAtEachVertex = 1
 
        self.waypointName = 'line'
+       self.waypointList = self.figureLine
+       self.queueDepth = 0
        self.scaleX  = 1.0
        self.scaleY  = 1.0
        self.offsetX = 0.0
@@ -142,8 +147,8 @@ class Controller:
        # read commandline arguments and place them in array
        # Only the -w option seems to work, something is wrong with getopt usage here
        try:
-           opts, args = getopt.getopt(sys.argv[1:], 'hcw:s:x:y:h', \
-               ['help','continue', 'waypoints=','scale=','offsetX=','offsetY='])
+           opts, args = getopt.getopt(sys.argv[1:], 'hcw:q:s:x:y:h', \
+               ['help','continue', 'waypoints=','queue=','scale=','offsetX=','offsetY='])
        except getopt.GetoptError as err:
            # will print something like "option -a not recognized"
            print "Error in recognized options"  
@@ -161,7 +166,7 @@ class Controller:
                self.waitAtEachVertex = 0
            elif o in ("-w", "--waypoints"):
                # define a waypoint list for waypoints
-               waypointName = a
+               self.waypointName = a
                if (a == "line"):
                    waypointList = self.figureLine
                elif (a == "box"):
@@ -174,6 +179,9 @@ class Controller:
                    print ("Invalid choice of waypoint list")
                    sys.exit(2)
                print "Waypoint list will be '%s'", waypointList
+               self.waypointList = waypointList
+           elif o in ("-q", "--queue"):
+               self.queueDepth = int(a)
            elif o in ("-s", "--scaleX"):
                self.scaleX = float(a)
                self.scaleY = float(a)
@@ -185,7 +193,7 @@ class Controller:
        print ("WaypointsName: %s scaleX %f scaleY %f offsetX %f offsetY %f" \
              %(self.waypointName,self.scaleX,self.scaleY,self.offsetX,self.offsetY))
 
-       print "A total of %d waypoints is in the list " % (len(waypointList))
+       print "A total of %d waypoints is in the list " % (len(self.waypointList))
 
 
     # A publisher for sending commands to the follower node
@@ -195,7 +203,7 @@ class Controller:
     # Publish the desired waypoint to navigate on top of now
     # For fiducial nav use frame_id of  "map"  
     # For odom nav use frame_id of "odom"
-    def publishMoveBaseGoalWaitForReply(self, x, y, yaw, comment):
+    def makeMoveBaseGoal(self, x, y, yaw, comment):
         goal = MoveBaseGoal()
         goal.target_pose.header.frame_id = "map"     
         goal.target_pose.header.stamp = rospy.Time.now()
@@ -211,6 +219,10 @@ class Controller:
         now = rospy.get_rostime()
         print "[%i.%i]  PubMove:  %s x,y,z,w of %f %f %f %f yaw %f" \
               % (now.secs,now.nsecs,comment,x,y,z,w,yaw)
+        return goal
+
+    def publishMoveBaseGoalWaitForReply(self, x, y, yaw, comment):
+        goal = self.makeMoveBaseGoal(x, y, yaw, comment)
 
         client = actionlib.SimpleActionClient('move_base', MoveBaseAction)
         client.wait_for_server()
@@ -229,17 +241,55 @@ class Controller:
             print "[%i.%i]  Received result" % (now.secs, now.nsecs)
             return client.get_result()
 
+    """
+    Send the whole waypoint list, keeping queueDepth goals sent ahead so
+    that move_smooth can plan its speed through the corners.
+    Returns the time taken in seconds.
+    """
+    def runQueued(self, waypointList):
+       client = actionlib.ActionClient('move_base', MoveBaseAction)
+       client.wait_for_server()
+
+       start = rospy.get_rostime()
+       pending = []
+       for waypoint in waypointList + [None]:
+           # wait for room in the queue, or at the end for all goals to finish
+           while len(pending) >= self.queueDepth or (waypoint is None and pending):
+               if pending[0].get_comm_state() == actionlib.CommState.DONE:
+                   if pending[0].get_goal_status() != actionlib.GoalStatus.SUCCEEDED:
+                       print "ERROR: MoveBasic Bad Status! %s" % (pending[0].get_goal_status_text())
+                   pending.pop(0)
+               else:
+                   rospy.sleep(self.loop_msec / 1000.0)
+           if waypoint is None:
+               break
+
+           x,y,yaw,comment = waypoint
+           x = (x * self.scaleX) + self.offsetX
+           y = (y * self.scaleY) + self.offsetY
+           pending.append(client.send_goal(self.makeMoveBaseGoal(x, y, yaw, comment)))
+
+       return (rospy.get_rostime() - start).to_sec()
+
     """
     Main loop
     """
     def run(self):
 
        print "ROS publisher publishing goals to move basic"
-       waypointList = self.figureLine
+       waypointList = self.waypointList
 
        # continue going through waypoints over and over.
        # If you only want to do list once exit after first for loop
        while (True):
+           if self.queueDepth > 0:
+               missionTime = self.runQueued(waypointList)
+               print "Pattern '%s' of %d waypoints took %f seconds" \
+                     % (self.waypointName, len(waypointList), missionTime)
+               if (self.waitAtEachVertex == 1):
+                   raw_input("Hit ENTER to run the pattern again ... ")
+               continue
+
            for waypoint in waypointList:
                x,y,yaw,comment = waypoint
                x = (x * self.scaleX) + self.offsetX
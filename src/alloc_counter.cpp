@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include "move_smooth/alloc_counter.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+#include <ros/ros.h>
+
+#ifdef MOVE_SMOOTH_ALLOC_CHECK
+
+namespace
+{
+thread_local uint64_t allocations = 0;
+thread_local int ignore_depth = 0;
+
+void* counted_alloc(std::size_t size)
+{
+    if (ignore_depth == 0) {
+        allocations++;
+    }
+    return std::malloc(size ? size : 1);
+}
+}
+
+void* operator new(std::size_t size)
+{
+    void* p = counted_alloc(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_alloc(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+namespace alloc_counter
+{
+
+uint64_t count()
+{
+    return allocations;
+}
+
+bool enabled()
+{
+    return true;
+}
+
+Ignore::Ignore()
+{
+    ignore_depth++;
+}
+
+Ignore::~Ignore()
+{
+    ignore_depth--;
+}
+
+}
+
+#else
+
+namespace alloc_counter
+{
+
+uint64_t count()
+{
+    return 0;
+}
+
+bool enabled()
+{
+    return false;
+}
+
+Ignore::Ignore()
+{
+}
+
+Ignore::~Ignore()
+{
+}
+
+}
+
+#endif
+
+AllocationCheck::AllocationCheck(const char* name, int warmup) : name(name),
+                                                                 warmup(warmup),
+                                                                 iterations(0),
+                                                                 start(0),
+                                                                 failures(0)
+{
+    if (alloc_counter::enabled()) {
+        ROS_INFO("Checking %s for allocations after %d iterations", name, warmup);
+    }
+}
+
+void AllocationCheck::begin()
+{
+    start = alloc_counter::count();
+}
+
+void AllocationCheck::end()
+{
+    uint64_t allocated = alloc_counter::count() - start;
+    if (iterations < warmup) {
+        iterations++;
+        return;
+    }
+    if (allocated > 0) {
+        failures++;
+        ROS_ERROR_THROTTLE(1.0, "%s: %lu allocations in one iteration, %lu iterations have allocated",
+                           name, (unsigned long) allocated, (unsigned long) failures);
+        assert(!"allocation in a checked iteration");
+    }
+}
+
+void AllocationCheck::restart()
+{
+    iterations = 0;
+}
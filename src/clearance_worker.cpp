@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include "move_smooth/clearance_worker.h"
+#include "move_smooth/trace.h"
+
+#include <atomic>
+
+ClearanceWorker::ClearanceWorker(CollisionChecker& checker, double min_rate) : checker(checker),
+                                                                               period(1.0 / min_rate),
+                                                                               trigger(nullptr),
+                                                                               query_time(nullptr),
+                                                                               linear(0),
+                                                                               angular(0),
+                                                                               running(false)
+{
+    std::shared_ptr<Clearance> initial = std::make_shared<Clearance>();
+    initial->version = 0;
+    initial->forward = initial->rear = 0;
+    initial->left = initial->right = 0;
+    initial->rotate_left = initial->rotate_right = 0;
+    initial->arc = 0;
+    std::atomic_store(&clearance, std::shared_ptr<const Clearance>(initial));
+}
+
+ClearanceWorker::~ClearanceWorker()
+{
+    stop();
+}
+
+void ClearanceWorker::start()
+{
+    if (running) {
+        return;
+    }
+    update();
+    running = true;
+    thread = std::thread(&ClearanceWorker::loop, this);
+}
+
+void ClearanceWorker::stop()
+{
+    running = false;
+    // wake the thread up
+    obstacles.notify(ros::Time());
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void ClearanceWorker::set_update_trigger(UpdateTrigger* trigger)
+{
+    this->trigger = trigger;
+}
+
+void ClearanceWorker::set_velocity(double linear, double angular)
+{
+    const std::lock_guard<std::mutex> lock(velocity_mutex);
+    this->linear = linear;
+    this->angular = angular;
+}
+
+std::shared_ptr<const Clearance> ClearanceWorker::get_clearance() const
+{
+    return std::atomic_load(&clearance);
+}
+
+void ClearanceWorker::loop()
+{
+    trace::set_thread_name("clearance worker");
+    uint64_t seen = obstacles.count();
+    while (running && ros::ok()) {
+        obstacles.wait(seen, period);
+        seen = obstacles.count();
+        if (running) {
+            trace::Scope scope("clearance update");
+            update();
+        }
+    }
+}
+
+void ClearanceWorker::update()
+{
+    double v, w;
+    {
+        const std::lock_guard<std::mutex> lock(velocity_mutex);
+        v = linear;
+        w = angular;
+    }
+
+    std::shared_ptr<Clearance> next;
+    for (auto& pooled : clearance_pool) {
+        if (!pooled) {
+            pooled = std::make_shared<Clearance>();
+        }
+        if (pooled.use_count() == 1) {
+            // The last reader dropped it, order the rewrite after its reads
+            std::atomic_thread_fence(std::memory_order_acquire);
+            next = pooled;
+            break;
+        }
+    }
+    if (!next) {
+        next = std::make_shared<Clearance>();
+    }
+
+    if (query_time) {
+        StageTimer timer(*query_time);
+        checker.clearance(v, w, *next);
+    }
+    else {
+        checker.clearance(v, w, *next);
+    }
+
+    uint64_t previous = get_clearance()->version;
+    std::atomic_store(&clearance, std::shared_ptr<const Clearance>(next));
+
+    // Only new obstacle data is worth waking the control loop for
+    if (trigger && next->version != previous) {
+        trigger->notify(next->stamp);
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include "move_smooth/clock.h"
+
+const Clock& Clock::ros_clock()
+{
+    static const RosClock clock;
+    return clock;
+}
+
+ros::Time RosClock::now() const
+{
+    return ros::Time::now();
+}
+
+void RosClock::sleep_until(const ros::Time& time) const
+{
+    ros::Time::sleepUntil(time);
+}
+
+ManualClock::ManualClock(const ros::Time& start) : nsec(start.toNSec())
+{
+}
+
+ros::Time ManualClock::now() const
+{
+    ros::Time time;
+    time.fromNSec(nsec.load(std::memory_order_acquire));
+    return time;
+}
+
+void ManualClock::sleep_until(const ros::Time& time) const
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    moved.wait(lock, [&]() { return now() >= time; });
+}
+
+// The time moves under the mutex, so that a sleeper can't miss it
+void ManualClock::set(const ros::Time& time)
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        nsec.store(time.toNSec(), std::memory_order_release);
+    }
+    moved.notify_all();
+}
+
+void ManualClock::advance(const ros::Duration& duration)
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        nsec.fetch_add(duration.toNSec(), std::memory_order_acq_rel);
+    }
+    moved.notify_all();
+}
+
+ClockRate::ClockRate(const Clock& clock, double frequency) : clock(clock),
+                                                             period(1.0 / frequency),
+                                                             next(clock.now())
+{
+}
+
+void ClockRate::sleep()
+{
+    ros::Time now = clock.now();
+    next = next + period;
+    if (now > next + period || now + period < next) {
+        next = now;
+        return;
+    }
+    clock.sleep_until(next);
+}
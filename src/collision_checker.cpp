@@ -68,18 +68,25 @@
 #include <tf2_ros/buffer.h>
 #include <tf2_ros/transform_listener.h>
 #include <sensor_msgs/Range.h>
-#include <visualization_msgs/Marker.h>
+#include <visualization_msgs/MarkerArray.h>
 #include "move_smooth/collision_checker.h"
+#include "move_smooth/alloc_counter.h"
+#include "move_smooth/trace.h"
 
 
 CollisionChecker::CollisionChecker(ros::NodeHandle& nh, tf2_ros::Buffer &tf_buffer, 
-		                   ObstaclePoints& op) : tf_buffer(tf_buffer),
-	                                                 ob_points(op)
+		                   ObstaclePoints& op) : marker_count(0),
+	                                                 tf_buffer(tf_buffer),
+	                                                 ob_points(op),
+	                                                 clock(op.get_clock())
 {
     nh.param<std::string>("base_frame", baseFrame, "base_link");
 
     line_pub = ros::Publisher(
-                 nh.advertise<visualization_msgs::Marker>("/obstacle_viz", 10));
+                 nh.advertise<visualization_msgs::MarkerArray>("/obstacle_viz", 10));
+    // 0 publishes the markers on every query
+    double marker_rate = nh.param<double>("marker_rate", 10.0);
+    marker_period = ros::Duration(marker_rate > 0 ? 1.0 / marker_rate : 0.0);
 
     max_age = nh.param<float>("max_age", 1.0);
     no_obstacle_dist = nh.param<float>("no_obstacle_dist", 10.0);
@@ -89,20 +96,19 @@ CollisionChecker::CollisionChecker(ros::NodeHandle& nh, tf2_ros::Buffer &tf_buff
     robot_front_length = nh.param<float>("robot_front_length", 0.09);
     robot_back_length = nh.param<float>("robot_back_length", 0.19);
 
-    robot_width_sq = robot_width * robot_width;
-    robot_front_length_sq = robot_front_length * robot_front_length;
-    robot_back_length_sq = robot_back_length * robot_back_length;
-
-    // To test if obstacles will intersect when rotating
-    front_diag = robot_width*robot_width + robot_front_length*robot_front_length;
-    back_diag = robot_width*robot_width + robot_back_length*robot_back_length;
+    footprint.width = robot_width;
+    footprint.front_length = robot_front_length;
+    footprint.back_length = robot_back_length;
+    rotate_radius = std::sqrt(robot_width * robot_width +
+                              std::pow(std::max(robot_front_length, robot_back_length), 2));
 
+    ROS_INFO("Collision checker using %s kernels", collision_kernels::implementation());
 }
 
 void CollisionChecker::draw_line(const tf2::Vector3 &p1, const tf2::Vector3 &p2,
                             float r, float g, float b, int id)
 {
-    visualization_msgs::Marker line;
+    visualization_msgs::Marker& line = next_marker();
     line.type = visualization_msgs::Marker::LINE_LIST;
     line.action = visualization_msgs::Marker::MODIFY;
     line.header.frame_id = baseFrame;
@@ -115,25 +121,56 @@ void CollisionChecker::draw_line(const tf2::Vector3 &p1, const tf2::Vector3 &p2,
     line.pose.position.x = 0;
     line.pose.position.y = 0;
     line.pose.orientation.w = 1;
-    geometry_msgs::Point gp1, gp2;
+    line.points.resize(2);
+    geometry_msgs::Point& gp1 = line.points[0];
+    geometry_msgs::Point& gp2 = line.points[1];
     gp1.x = p1.x();
     gp1.y = p1.y();
     gp1.z = p1.z();
     gp2.x = p2.x();
     gp2.y = p2.y();
     gp2.z = p2.z();
-    line.points.push_back(gp1);
-    line.points.push_back(gp2);
-    line_pub.publish(line);
 }
 
 void CollisionChecker::clear_line(int id)
 {
-    visualization_msgs::Marker line;
+    visualization_msgs::Marker& line = next_marker();
     line.type = visualization_msgs::Marker::LINE_LIST;
     line.action = visualization_msgs::Marker::DELETE;
     line.id = id;
-    line_pub.publish(line);
+    line.points.clear();
+}
+
+// Markers are reused between queries, so that drawing the same lines
+// again doesn't allocate
+visualization_msgs::Marker& CollisionChecker::next_marker()
+{
+    if (marker_count == markers.markers.size()) {
+        markers.markers.emplace_back();
+    }
+    return markers.markers[marker_count++];
+}
+
+/*
+ Returns true if the debug lines should be drawn for this query: only
+ when someone is listening on /obstacle_viz, and at most marker_rate
+ times a second.
+*/
+bool CollisionChecker::start_markers(const ros::Time& now)
+{
+    if (line_pub.getNumSubscribers() == 0 || now - last_markers < marker_period) {
+        return false;
+    }
+    last_markers = now;
+    marker_count = 0;
+    return true;
+}
+
+void CollisionChecker::publish_markers()
+{
+    markers.markers.resize(marker_count);
+    alloc_counter::Ignore ignore;
+    line_pub.publish(markers);
 }
 
 inline void CollisionChecker::check_dist(float x, bool forward, float& min_dist) const
@@ -150,45 +187,43 @@ inline void CollisionChecker::check_dist(float x, bool forward, float& min_dist)
     }
 }
 
-float CollisionChecker::obstacle_dist(bool forward,
-                                      float &min_dist_left,
-                                      float &min_dist_right,
-                                      tf2::Vector3 &fl,
-                                      tf2::Vector3 &fr)
+void CollisionChecker::sweep_lines(const ObstacleSnapshot& snapshot, const ros::Time& now,
+                                   collision_kernels::DistResult& result) const
 {
-    float min_dist = no_obstacle_dist;
-    min_dist_left = no_obstacle_dist;
-    min_dist_right = no_obstacle_dist;
-
-    auto lines = ob_points.get_lines(ros::Duration(max_age));
-    for (const auto& points : lines) {
-	float x0 = points.first.x();
-	float y0 = points.first.y();
-	float x1 = points.second.x();
-	float y1 = points.second.y();
+    float& min_dist_left = result.left;
+    float& min_dist_right = result.right;
+
+    // sonar cones are checked both ways, the caller picks the direction
+    auto check = [&](float x) {
+        check_dist(x, true, result.forward);
+        check_dist(x, false, result.rear);
+    };
+
+    snapshot.for_each_line(now, ros::Duration(max_age),
+                           [&](float x0, float y0, float x1, float y1) {
 	// Forward and rear limits
 	if (y0 < -robot_width && robot_width < y1) {
 	    // linear interpolate to get closest point inside width
 	    float ylen = y1 - y0;
 	    float a0 = (y0 - robot_width) / ylen;
 	    float a1 = (y1 - robot_width - y0) / ylen;
-	    check_dist(a0 * x0 + (1.0 - a0) * x1, forward, min_dist);
-	    check_dist(a1 * x1 + (1.0 - a1) * x0, forward, min_dist);
+	    check(a0 * x0 + (1.0 - a0) * x1);
+	    check(a1 * x1 + (1.0 - a1) * x0);
 	}
 	else if (y1 < -robot_width && robot_width < y0) {
 	    // linear interpolate to get closest point inside width
 	    float ylen = y0 - y1;
 	    float a0 = (y0 - robot_width - y1) / ylen;
 	    float a1 = (y1 - robot_width) / ylen;
-	    check_dist(a0 * x0 + (1.0 - a0) * x1, forward, min_dist);
-	    check_dist(a1 * x1 + (1.0 - a1) * x0, forward, min_dist);
+	    check(a0 * x0 + (1.0 - a0) * x1);
+	    check(a1 * x1 + (1.0 - a1) * x0);
 	}
 	else {
 	    if (-robot_width < y0 && y0 < robot_width) {
-		check_dist(x0, forward, min_dist);
+		check(x0);
 	    }
 	    if (-robot_width < y1 && y1 < robot_width) {
-		check_dist(x1, forward, min_dist);
+		check(x1);
 	    }
 	}
 	// Sides
@@ -250,33 +285,87 @@ float CollisionChecker::obstacle_dist(bool forward,
 		}
 	    }
 	}
+    });
+}
+
+void CollisionChecker::sweep_points(const ObstacleSnapshot& snapshot, const ros::Time& now,
+                                    collision_kernels::DistResult& result) const
+{
+    auto fold = [&](const float* x, const float* y, size_t n) {
+        collision_kernels::dist_points(footprint, x, y, n, result);
+    };
+
+    const ros::Duration age(max_age);
+    if (snapshot.lidar_grid && now - snapshot.lidar_stamp < age) {
+        const ObstacleGrid& grid = *snapshot.lidar_grid;
+        grid.for_each_overflow(fold);
+
+        // Each band is swept outwards from the footprint, until a row of
+        // cells can't hold anything closer than what was already found
+        grid.sweep_x(true, robot_front_length, -robot_width, robot_width, fold,
+                     [&]() { return result.forward; });
+        grid.sweep_x(false, robot_back_length, -robot_width, robot_width, fold,
+                     [&]() { return result.rear; });
+        grid.sweep_y(true, 0, -robot_back_length, robot_front_length, fold,
+                     [&]() { return result.left; });
+        grid.sweep_y(false, 0, -robot_back_length, robot_front_length, fold,
+                     [&]() { return result.right; });
     }
+    snapshot.for_each_other_cloud(now, age, fold);
+}
 
-    // Forward side points
-    fl.setX(robot_front_length);
-    fl.setY(min_dist_left);
-    fr.setX(robot_front_length);
-    fr.setY(min_dist_right);
-    
-    auto pts = ob_points.get_points(ros::Duration(max_age));
-    for (const auto& p : pts) {
-       float y = p.y();
-       float x = p.x();
-       // Forward and rear
-       if (-robot_width < y && y < robot_width) {
-          check_dist(x, forward, min_dist);
-       }
-       // Sides
-       if (x > -robot_back_length && x < robot_front_length) {
-          if (y > 0 && y < min_dist_left) {
-	     min_dist_left = y;
-	  }
-	  else if (y < 0 && -y < min_dist_right) {
-             min_dist_right = -y;
-	  }
-       }
+bool CollisionChecker::make_arc(double linear, double angular,
+                                collision_kernels::Arc& arc) const
+{
+    // Driving straight, there is no arc
+    if (angular == 0) {
+        return false;
     }
 
+    const float radius = (float) std::abs(linear/angular);
+    const bool forward = linear >= 0;
+    const bool left = angular >= 0;
+
+    // Point of rotation relative to base_link
+    const auto point_of_rotation = tf2::Vector3(0, (left) ? radius : -radius, 0);
+
+    // Critical robot corners relative to point of rotation
+    const auto outer_point = tf2::Vector3(-robot_back_length, 
+            (left) ? -robot_width: robot_width, 0) - point_of_rotation;
+    const auto inner_point = tf2::Vector3(robot_front_length, 
+            (left) ? robot_width: -robot_width, 0) - point_of_rotation;
+
+    // Critical robot points in polar (r^2, theta) form relative to center 
+    // of rotation
+    arc.centre_y = point_of_rotation.y();
+    arc.outer_radius_sq = outer_point.length2();
+    arc.outer_theta = std::atan2(outer_point.y(), outer_point.x());
+    arc.inner_radius_sq = inner_point.length2();
+    //Not used const float inner_theta = std::atan2(inner_point.x(), -inner_point.y());
+    arc.forward = forward;
+    arc.left = left;
+    return true;
+}
+
+/*
+ Range of distances from base_link of the obstacles that can be inside
+ the swept annulus, a point at radius d from the centre of rotation is
+ between |d - centre_y| and d + |centre_y| from base_link.
+*/
+void CollisionChecker::arc_radii(const collision_kernels::Arc& arc,
+                                 float& min_radius, float& max_radius) const
+{
+    const float centre = std::abs(arc.centre_y);
+    const float inner = std::sqrt(arc.inner_radius_sq);
+    const float outer = std::sqrt(arc.outer_radius_sq);
+    min_radius = std::max(0.0f, std::max(centre - outer, inner - centre));
+    max_radius = centre + outer;
+}
+
+void CollisionChecker::draw_dist(bool forward, float min_dist,
+                                 float min_dist_left, float min_dist_right,
+                                 const tf2::Vector3 &fl, const tf2::Vector3 &fr)
+{
     // Green lines at sides
     draw_line(tf2::Vector3(robot_front_length, min_dist_left, 0),
               tf2::Vector3(-robot_back_length, min_dist_left, 0), 0, 1, 0, 20000);
@@ -313,52 +402,15 @@ float CollisionChecker::obstacle_dist(bool forward,
 
         draw_line(tf2::Vector3(min_dist, robot_width + 2, 0),
                   tf2::Vector3(min_dist, robot_width, 0), 0.5, 0, 0, 10030);
-        min_dist -= robot_front_length;
     }
     else {
         draw_line(tf2::Vector3(-min_dist, -robot_width, 0),
                   tf2::Vector3(-min_dist, robot_width, 0), 1, 0, 0, 10000);
-        min_dist -= robot_back_length;
-    }
-
-    min_dist_left -= robot_width;
-    min_dist_right -= robot_width;
-    return min_dist;
-}
-
-float CollisionChecker::degrees(float radians) const
-{
-    return radians * 180.0 / M_PI;
-}
-
-/*
- Determine the rotation required to for to move point from its
- initial rotation of theta to (x, y), and store the smallest
- value
-*/
-inline void CollisionChecker::check_angle(float theta, float x, float y,
-                                          bool left, float& min_dist) const
-{
-    float theta_int = theta - std::atan2(y, x);
-    if (theta_int < -M_PI) {
-        theta_int += 2.0 * M_PI;
-    }
-    if (theta_int > M_PI) {
-        theta_int -= 2.0 * M_PI;
-    }
-    if (left && theta_int > 0 && theta_int < min_dist) {
-        min_dist = theta_int;
-    }
-    if (!left && theta_int < 0 && -theta_int < min_dist) {
-        min_dist = -theta_int;
     }
 }
 
-float CollisionChecker::obstacle_angle(bool left)
+void CollisionChecker::draw_angle(bool left, float min_angle)
 {
-    float min_angle = M_PI;
-
-    auto points = ob_points.get_points(ros::Duration(max_age));
     // draw footprint
     draw_line(tf2::Vector3(robot_front_length, robot_width, 0),
               tf2::Vector3(-robot_back_length, robot_width, 0),
@@ -373,55 +425,6 @@ float CollisionChecker::obstacle_angle(bool left)
               tf2::Vector3(-robot_back_length, -robot_width, 0),
               0.28, 0.5, 1, 10006);
 
-    for (const auto& p : points) {
-        float x = p.x();
-        float y = p.y();
-        // initial orientation wrt base_link
-        float theta = std::atan2(y, x);
-        float r_squared = x*x + y*y;
-        if (r_squared <= back_diag) {
-           // left line segment:
-           //   y = robot_width, -robot_back_length <= x <= robot_front_length
-           // right line segment:
-           //   y = -robot_width, -robot_back_length <= x <= robot_front_length
-           if (robot_width_sq <= r_squared) {
-               float xi = std::sqrt(r_squared - robot_width_sq);
-               if (-robot_back_length <= xi && xi <= robot_front_length) {
-                   check_angle(theta, xi, robot_width, left, min_angle);
-                   check_angle(theta, xi, -robot_width, left, min_angle);
-               }
-               if (-robot_back_length <= -xi && -xi <= robot_front_length) {
-                   check_angle(theta, -xi, robot_width, left, min_angle);
-                   check_angle(theta, -xi, -robot_width, left, min_angle);
-               }
-           }
-
-           // back line segment:
-           //   x = -robot_back_length, -robot_width <= y <= robot_width
-           if (x < 0 && robot_back_length_sq <= r_squared) {
-               float yi = std::sqrt(r_squared - robot_back_length_sq);
-               if (-robot_width <= yi && yi <= robot_width) {
-                   check_angle(theta, -robot_back_length, yi, left, min_angle);
-               }
-               if (-robot_width <= -yi && -yi <= robot_width) {
-                   check_angle(theta, -robot_back_length, -yi, left, min_angle);
-               }
-           }
-
-           // front line segment:
-           //   x = robot_front_length, -robot_width <= y <= robot_width
-           if (x > 0 && r_squared <= front_diag && robot_front_length_sq <= r_squared) {
-               float yi = std::sqrt(r_squared - robot_front_length_sq);
-               if (-robot_width <= yi && yi <= robot_width) {
-                   check_angle(theta, robot_front_length, yi, left, min_angle);
-               }
-               if (-robot_width <= -yi && -yi <= robot_width) {
-                   check_angle(theta, robot_front_length, -yi, left, min_angle);
-               }
-           }
-        }
-    }
-
     // Draw rotated footprint to show limit of rotation
     float rotation;
     if (left) {
@@ -458,77 +461,167 @@ float CollisionChecker::obstacle_angle(bool left)
         clear_line(10012);
         clear_line(10013);
     }
-
-    ROS_DEBUG("min angle %f\n", degrees(min_angle));
-    return min_angle;
 }
 
+float CollisionChecker::obstacle_dist(bool forward,
+                                      float &min_dist_left,
+                                      float &min_dist_right,
+                                      tf2::Vector3 &fl,
+                                      tf2::Vector3 &fr)
+{
+    trace::Scope scope("obstacle_dist");
+    ros::Time now = clock.now();
+    auto snapshot = ob_points.get_snapshot();
 
-float CollisionChecker::obstacle_arc_angle(double linear, double angular) {
-    const float radius = (float) std::abs(linear/angular);
-    const bool forward = linear >= 0;
-    const bool left = angular >= 0;
+    collision_kernels::DistResult result;
+    result.forward = no_obstacle_dist;
+    result.rear = no_obstacle_dist;
+    result.left = no_obstacle_dist;
+    result.right = no_obstacle_dist;
 
-    // Point of rotation relative to base_link
-    const auto point_of_rotation = tf2::Vector3(0, (left) ? radius : -radius, 0);
+    sweep_lines(*snapshot, now, result);
 
-    // Critical robot corners relative to point of rotation
-    const auto outer_point = tf2::Vector3(-robot_back_length, 
-            (left) ? -robot_width: robot_width, 0) - point_of_rotation;
-    const auto inner_point = tf2::Vector3(robot_front_length, 
-            (left) ? robot_width: -robot_width, 0) - point_of_rotation;
+    // Forward side points
+    fl.setX(robot_front_length);
+    fl.setY(result.left);
+    fr.setX(robot_front_length);
+    fr.setY(result.right);
 
-    // Critical robot points in polar (r^2, theta) form relative to center 
-    // of rotation
-    const float outer_radius_sq = outer_point.length2();
-    const float outer_theta = std::atan2(outer_point.y(), outer_point.x());
-    const float inner_radius_sq = inner_point.length2();
-    //Not used const float inner_theta = std::atan2(inner_point.x(), -inner_point.y());
+    sweep_points(*snapshot, now, result);
 
-    // Utility function to make sure that the angle relevant and not behind the robot
-    const auto angle_relevant = [&outer_theta, &left, &forward](float angle) -> bool {
-        if (forward) {
-            if (left) {
-                return angle > outer_theta;
-            } else {
-                return angle < outer_theta;
-            }
-        } else {
-            if (angle < 0) {
-                angle += 2.0 * M_PI;
-            }
-
-            if (left) {
-                return angle < outer_theta;
-            } else {
-                return angle > outer_theta;
-            }
-        }
-    };
+    float min_dist = forward ? result.forward : result.rear;
+    min_dist_left = result.left;
+    min_dist_right = result.right;
+
+    if (start_markers(now)) {
+        draw_dist(forward, min_dist, min_dist_left, min_dist_right, fl, fr);
+        publish_markers();
+    }
+
+    if (forward) {
+        min_dist -= robot_front_length;
+    }
+    else {
+        min_dist -= robot_back_length;
+    }
 
+    min_dist_left -= robot_width;
+    min_dist_right -= robot_width;
+    return min_dist;
+}
+
+float CollisionChecker::degrees(float radians) const
+{
+    return radians * 180.0 / M_PI;
+}
+
+float CollisionChecker::obstacle_angle(bool left)
+{
+    trace::Scope scope("obstacle_angle");
+    ros::Time now = clock.now();
+    auto snapshot = ob_points.get_snapshot();
+
+    collision_kernels::AngleResult result;
+    result.left = M_PI;
+    result.right = M_PI;
+
+    snapshot->for_each_polar(now, ros::Duration(max_age), 0, rotate_radius,
+                             [&](const float* x, const float* y, size_t n) {
+        collision_kernels::angle_points(footprint, x, y, n, result);
+    });
+    float min_angle = left ? result.left : result.right;
+
+    if (start_markers(now)) {
+        draw_angle(left, min_angle);
+        publish_markers();
+    }
+
+    ROS_DEBUG("min angle %f\n", degrees(min_angle));
+    return min_angle;
+}
+
+float CollisionChecker::obstacle_arc_angle(double linear, double angular)
+{
+    trace::Scope scope("obstacle_arc_angle");
     float closest_angle = M_PI;
-    const auto points = ob_points.get_points(ros::Duration(max_age));
-    for (const auto& p : points) {
-        // Trasform the obstacle point into the coordiate system with the 
-        // point of rotation at the origin, with the same orientation as base_link
-        const tf2::Vector3 p_in_rot = p - point_of_rotation;
-        // Radius for polar coordinates around center of rotation 
-        const float p_radius_sq = p_in_rot.length2();
-
-        if(p_radius_sq < outer_radius_sq && p_radius_sq > inner_radius_sq) {
-            // Angle for polar coordinates around center of rotation
-            const float p_theta = std::atan2(p_in_rot.y(), p_in_rot.x());
-            if (angle_relevant(p_theta) && p_theta < M_PI) {
-                // TODO: This assumes that any collision with the point will be
-                // on the leading part of the robot, when in reality we can turn more
-                // than this amount if the point only causes a collision with the rear
-                // part of the robot as it swings around for a turn
-                closest_angle = std::min(closest_angle, p_theta);
-            }
-        }
+
+    collision_kernels::Arc arc;
+    if (!make_arc(linear, angular, arc)) {
+        return closest_angle;
     }
 
+    float min_radius, max_radius;
+    arc_radii(arc, min_radius, max_radius);
+
+    const auto snapshot = ob_points.get_snapshot();
+    snapshot->for_each_polar(clock.now(), ros::Duration(max_age), min_radius, max_radius,
+                             [&](const float* x, const float* y, size_t n) {
+        collision_kernels::arc_points(arc, x, y, n, closest_angle);
+    });
+
     // TODO: Check obstacle lines for intersection with robot arc
 
     return closest_angle;
 }
+
+void CollisionChecker::clearance(double linear, double angular, Clearance& out)
+{
+    trace::Scope scope("clearance");
+    ros::Time now = clock.now();
+    auto snapshot = ob_points.get_snapshot();
+
+    collision_kernels::DistResult dist;
+    dist.forward = no_obstacle_dist;
+    dist.rear = no_obstacle_dist;
+    dist.left = no_obstacle_dist;
+    dist.right = no_obstacle_dist;
+
+    sweep_lines(*snapshot, now, dist);
+    tf2::Vector3 fl(robot_front_length, dist.left, 0);
+    tf2::Vector3 fr(robot_front_length, dist.right, 0);
+
+    collision_kernels::AngleResult angle;
+    angle.left = M_PI;
+    angle.right = M_PI;
+
+    float arc_angle = M_PI;
+    collision_kernels::Arc arc;
+    bool have_arc = make_arc(linear, angular, arc);
+
+    sweep_points(*snapshot, now, dist);
+
+    // Rotation and arc only need the rings of the polar index they can
+    // reach.  Both kernels skip points out of their reach, so they share
+    // one walk over the rings either needs.
+    // an empty range when there is no arc
+    float min_radius = 1.0f;
+    float max_radius = 0.0f;
+    if (have_arc) {
+        arc_radii(arc, min_radius, max_radius);
+    }
+    snapshot->for_each_polar(now, ros::Duration(max_age), 0, rotate_radius,
+                             min_radius, max_radius,
+                             [&](const float* x, const float* y, size_t n) {
+        collision_kernels::angle_points(footprint, x, y, n, angle);
+        if (have_arc) {
+            collision_kernels::arc_points(arc, x, y, n, arc_angle);
+        }
+    });
+
+    bool forward = linear >= 0;
+    if (start_markers(now)) {
+        draw_dist(forward, forward ? dist.forward : dist.rear, dist.left, dist.right, fl, fr);
+        draw_angle(angular >= 0, angular >= 0 ? angle.left : angle.right);
+        publish_markers();
+    }
+
+    out.version = snapshot->version;
+    out.stamp = snapshot->stamp;
+    out.forward = dist.forward - robot_front_length;
+    out.rear = dist.rear - robot_back_length;
+    out.left = dist.left - robot_width;
+    out.right = dist.right - robot_width;
+    out.rotate_left = angle.left;
+    out.rotate_right = angle.right;
+    out.arc = arc_angle;
+}
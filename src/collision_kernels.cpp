@@ -0,0 +1,712 @@
+/*
+ * Copyright (c) 2018-9, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+/*
+
+ Vectorised versions of the CollisionChecker inner loops.
+
+ All versions compute the same masks as the scalar code: a point only
+ contributes to a minimum if it lies in the corresponding band, which
+ is done by replacing points outside the band with +infinity before the
+ min.  There are no data dependent branches in the vector loops, the
+ remainder of each array is handled by the scalar version.
+
+*/
+
+#include "move_smooth/collision_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLLISION_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace collision_kernels
+{
+
+namespace
+{
+
+typedef void (*DistPointsFn)(const Footprint&, const float*, const float*,
+                             size_t, DistResult&);
+typedef void (*AnglePointsFn)(const Footprint&, const float*, const float*,
+                              size_t, AngleResult&);
+
+struct Kernels
+{
+    DistPointsFn dist_points;
+    AnglePointsFn angle_points;
+    const char* name;
+};
+
+const float pi = M_PI;
+const float two_pi = 2.0 * M_PI;
+const float half_pi = M_PI / 2.0;
+
+// Points this close in angle to the footprint are touching it and
+// block rotation both ways. This also keeps the scalar and vector
+// versions from disagreeing about the sign of a rotation that is ~0.
+const float contact_angle = 1e-5;
+
+void dist_points_scalar(const Footprint& fp, const float* x, const float* y,
+                        size_t n, DistResult& result)
+{
+    float forward = result.forward;
+    float rear = result.rear;
+    float left = result.left;
+    float right = result.right;
+
+    for (size_t i = 0; i < n; i++) {
+        const float xi = x[i];
+        const float yi = y[i];
+        const bool in_width = -fp.width < yi && yi < fp.width;
+        const bool in_length = -fp.back_length < xi && xi < fp.front_length;
+
+        if (in_width && xi > fp.front_length) {
+            forward = std::min(forward, xi);
+        }
+        if (in_width && -xi > fp.back_length) {
+            rear = std::min(rear, -xi);
+        }
+        if (in_length && yi > 0) {
+            left = std::min(left, yi);
+        }
+        if (in_length && yi < 0) {
+            right = std::min(right, -yi);
+        }
+    }
+
+    result.forward = forward;
+    result.rear = rear;
+    result.left = left;
+    result.right = right;
+}
+
+/*
+ Determine the rotation required to move a point from its initial
+ bearing theta to (x, y) on the footprint, and store the smallest
+ value for each direction
+*/
+inline void check_angle(float theta, float x, float y, AngleResult& result)
+{
+    float theta_int = theta - std::atan2(y, x);
+    if (theta_int < -pi) {
+        theta_int += two_pi;
+    }
+    if (theta_int > pi) {
+        theta_int -= two_pi;
+    }
+    if (std::abs(theta_int) < contact_angle) {
+        result.left = 0;
+        result.right = 0;
+    }
+    if (theta_int > 0 && theta_int < result.left) {
+        result.left = theta_int;
+    }
+    if (theta_int < 0 && -theta_int < result.right) {
+        result.right = -theta_int;
+    }
+}
+
+void angle_points_scalar(const Footprint& fp, const float* xs, const float* ys,
+                         size_t n, AngleResult& result)
+{
+    const float width_sq = fp.width * fp.width;
+    const float front_sq = fp.front_length * fp.front_length;
+    const float back_sq = fp.back_length * fp.back_length;
+    const float front_diag = width_sq + front_sq;
+    const float back_diag = width_sq + back_sq;
+
+    for (size_t i = 0; i < n; i++) {
+        const float x = xs[i];
+        const float y = ys[i];
+        // initial orientation wrt base_link
+        const float theta = std::atan2(y, x);
+        const float r_squared = x*x + y*y;
+        if (r_squared > back_diag) {
+            continue;
+        }
+
+        // left line segment:
+        //   y = width, -back_length <= x <= front_length
+        // right line segment:
+        //   y = -width, -back_length <= x <= front_length
+        if (width_sq <= r_squared) {
+            float xi = std::sqrt(r_squared - width_sq);
+            if (-fp.back_length <= xi && xi <= fp.front_length) {
+                check_angle(theta, xi, fp.width, result);
+                check_angle(theta, xi, -fp.width, result);
+            }
+            if (-fp.back_length <= -xi && -xi <= fp.front_length) {
+                check_angle(theta, -xi, fp.width, result);
+                check_angle(theta, -xi, -fp.width, result);
+            }
+        }
+
+        // back line segment:
+        //   x = -back_length, -width <= y <= width
+        if (x < 0 && back_sq <= r_squared) {
+            float yi = std::sqrt(r_squared - back_sq);
+            if (-fp.width <= yi && yi <= fp.width) {
+                check_angle(theta, -fp.back_length, yi, result);
+            }
+            if (-fp.width <= -yi && -yi <= fp.width) {
+                check_angle(theta, -fp.back_length, -yi, result);
+            }
+        }
+
+        // front line segment:
+        //   x = front_length, -width <= y <= width
+        if (x > 0 && r_squared <= front_diag && front_sq <= r_squared) {
+            float yi = std::sqrt(r_squared - front_sq);
+            if (-fp.width <= yi && yi <= fp.width) {
+                check_angle(theta, fp.front_length, yi, result);
+            }
+            if (-fp.width <= -yi && -yi <= fp.width) {
+                check_angle(theta, fp.front_length, -yi, result);
+            }
+        }
+    }
+}
+
+#ifdef COLLISION_KERNELS_X86
+
+/*
+ The vector versions of angle_points evaluate all eight footprint
+ intersections of every point under masks.  atan2 is computed by
+ reducing to atan(z), 0 <= z <= 1, and a degree 11 minimax polynomial
+ (max error 2e-6 radians), then restoring the octant.  The intersections
+ only need three of these: the others follow from
+ atan2(-y, x) = -atan2(y, x) and atan2(y, -x) = pi - atan2(y, x).
+*/
+
+__attribute__((target("sse4.1")))
+float hmin_sse(__m128 v)
+{
+    v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_min_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+__attribute__((target("sse4.1")))
+void dist_points_sse41(const Footprint& fp, const float* x, const float* y,
+                       size_t n, DistResult& result)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    const __m128 width = _mm_set1_ps(fp.width);
+    const __m128 neg_width = _mm_set1_ps(-fp.width);
+    const __m128 front = _mm_set1_ps(fp.front_length);
+    const __m128 back = _mm_set1_ps(fp.back_length);
+    const __m128 neg_back = _mm_set1_ps(-fp.back_length);
+
+    __m128 forward = inf;
+    __m128 rear = inf;
+    __m128 left = inf;
+    __m128 right = inf;
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128 xv = _mm_loadu_ps(x + i);
+        const __m128 yv = _mm_loadu_ps(y + i);
+        const __m128 neg_x = _mm_sub_ps(zero, xv);
+        const __m128 neg_y = _mm_sub_ps(zero, yv);
+
+        const __m128 in_width = _mm_and_ps(_mm_cmplt_ps(neg_width, yv),
+                                           _mm_cmplt_ps(yv, width));
+        const __m128 in_length = _mm_and_ps(_mm_cmplt_ps(neg_back, xv),
+                                            _mm_cmplt_ps(xv, front));
+
+        __m128 m = _mm_and_ps(in_width, _mm_cmpgt_ps(xv, front));
+        forward = _mm_min_ps(forward, _mm_blendv_ps(inf, xv, m));
+
+        m = _mm_and_ps(in_width, _mm_cmpgt_ps(neg_x, back));
+        rear = _mm_min_ps(rear, _mm_blendv_ps(inf, neg_x, m));
+
+        m = _mm_and_ps(in_length, _mm_cmpgt_ps(yv, zero));
+        left = _mm_min_ps(left, _mm_blendv_ps(inf, yv, m));
+
+        m = _mm_and_ps(in_length, _mm_cmplt_ps(yv, zero));
+        right = _mm_min_ps(right, _mm_blendv_ps(inf, neg_y, m));
+    }
+
+    result.forward = std::min(result.forward, hmin_sse(forward));
+    result.rear = std::min(result.rear, hmin_sse(rear));
+    result.left = std::min(result.left, hmin_sse(left));
+    result.right = std::min(result.right, hmin_sse(right));
+
+    dist_points_scalar(fp, x + i, y + i, n - i, result);
+}
+
+__attribute__((target("sse4.1")))
+__m128 atan2_sse(__m128 y, __m128 x)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    const __m128 ax = _mm_andnot_ps(sign_mask, x);
+    const __m128 ay = _mm_andnot_ps(sign_mask, y);
+    const __m128 mn = _mm_min_ps(ax, ay);
+    const __m128 mx = _mm_max_ps(ax, ay);
+
+    __m128 z = _mm_div_ps(mn, mx);
+    z = _mm_blendv_ps(z, zero, _mm_cmpeq_ps(mx, zero));
+    const __m128 z2 = _mm_mul_ps(z, z);
+
+    __m128 p = _mm_set1_ps(-0.01172120f);
+    p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(0.05265332f));
+    p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(-0.11643287f));
+    p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(0.19354346f));
+    p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(-0.33262347f));
+    p = _mm_add_ps(_mm_mul_ps(p, z2), _mm_set1_ps(0.99997726f));
+    __m128 a = _mm_mul_ps(p, z);
+
+    // restore the octant, blendv selects on the sign bit of x
+    a = _mm_blendv_ps(a, _mm_sub_ps(_mm_set1_ps(half_pi), a), _mm_cmpgt_ps(ay, ax));
+    a = _mm_blendv_ps(a, _mm_sub_ps(_mm_set1_ps(pi), a), x);
+    return _mm_or_ps(a, _mm_and_ps(sign_mask, y));
+}
+
+// Fold the rotation from bearing theta to phi into left and right
+__attribute__((target("sse4.1")))
+inline void check_angle_sse(__m128 theta, __m128 phi, __m128 mask,
+                            __m128& left, __m128& right)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    const __m128 two_pi_v = _mm_set1_ps(two_pi);
+
+    __m128 t = _mm_sub_ps(theta, phi);
+    t = _mm_add_ps(t, _mm_and_ps(_mm_cmplt_ps(t, _mm_set1_ps(-pi)), two_pi_v));
+    t = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, _mm_set1_ps(pi)), two_pi_v));
+
+    __m128 m = _mm_and_ps(mask, _mm_cmpgt_ps(t, zero));
+    left = _mm_min_ps(left, _mm_blendv_ps(inf, t, m));
+
+    m = _mm_and_ps(mask, _mm_cmplt_ps(t, zero));
+    right = _mm_min_ps(right, _mm_blendv_ps(inf, _mm_sub_ps(zero, t), m));
+
+    const __m128 abs_t = _mm_andnot_ps(_mm_set1_ps(-0.0f), t);
+    m = _mm_and_ps(mask, _mm_cmplt_ps(abs_t, _mm_set1_ps(contact_angle)));
+    left = _mm_min_ps(left, _mm_blendv_ps(inf, zero, m));
+    right = _mm_min_ps(right, _mm_blendv_ps(inf, zero, m));
+}
+
+__attribute__((target("sse4.1")))
+void angle_points_sse41(const Footprint& fp, const float* xs, const float* ys,
+                        size_t n, AngleResult& result)
+{
+    const float width_sq = fp.width * fp.width;
+    const float front_sq = fp.front_length * fp.front_length;
+    const float back_sq = fp.back_length * fp.back_length;
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 inf = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    const __m128 pi_v = _mm_set1_ps(pi);
+    const __m128 width = _mm_set1_ps(fp.width);
+    const __m128 neg_width = _mm_set1_ps(-fp.width);
+    const __m128 front = _mm_set1_ps(fp.front_length);
+    const __m128 neg_back = _mm_set1_ps(-fp.back_length);
+    const __m128 width_sq_v = _mm_set1_ps(width_sq);
+    const __m128 front_sq_v = _mm_set1_ps(front_sq);
+    const __m128 back_sq_v = _mm_set1_ps(back_sq);
+    const __m128 front_diag = _mm_set1_ps(width_sq + front_sq);
+    const __m128 back_diag = _mm_set1_ps(width_sq + back_sq);
+
+    __m128 left = inf;
+    __m128 right = inf;
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128 x = _mm_loadu_ps(xs + i);
+        const __m128 y = _mm_loadu_ps(ys + i);
+        const __m128 r_squared = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+        const __m128 in_range = _mm_cmple_ps(r_squared, back_diag);
+        if (_mm_movemask_ps(in_range) == 0) {
+            continue;
+        }
+        const __m128 theta = atan2_sse(y, x);
+
+        // left and right line segments
+        __m128 m = _mm_and_ps(in_range, _mm_cmple_ps(width_sq_v, r_squared));
+        const __m128 xi = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(r_squared, width_sq_v), zero));
+        const __m128 neg_xi = _mm_sub_ps(zero, xi);
+        const __m128 side = atan2_sse(width, xi);
+        const __m128 side_back = _mm_sub_ps(pi_v, side);
+        __m128 mi = _mm_and_ps(m, _mm_and_ps(_mm_cmple_ps(neg_back, xi),
+                                             _mm_cmple_ps(xi, front)));
+        check_angle_sse(theta, side, mi, left, right);
+        check_angle_sse(theta, _mm_xor_ps(side, sign_mask), mi, left, right);
+        mi = _mm_and_ps(m, _mm_and_ps(_mm_cmple_ps(neg_back, neg_xi),
+                                      _mm_cmple_ps(neg_xi, front)));
+        check_angle_sse(theta, side_back, mi, left, right);
+        check_angle_sse(theta, _mm_xor_ps(side_back, sign_mask), mi, left, right);
+
+        // back line segment
+        m = _mm_and_ps(in_range, _mm_and_ps(_mm_cmplt_ps(x, zero),
+                                            _mm_cmple_ps(back_sq_v, r_squared)));
+        __m128 yi = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(r_squared, back_sq_v), zero));
+        __m128 neg_yi = _mm_sub_ps(zero, yi);
+        const __m128 rear = atan2_sse(yi, neg_back);
+        mi = _mm_and_ps(m, _mm_and_ps(_mm_cmple_ps(neg_width, yi), _mm_cmple_ps(yi, width)));
+        check_angle_sse(theta, rear, mi, left, right);
+        mi = _mm_and_ps(m, _mm_and_ps(_mm_cmple_ps(neg_width, neg_yi),
+                                      _mm_cmple_ps(neg_yi, width)));
+        check_angle_sse(theta, _mm_xor_ps(rear, sign_mask), mi, left, right);
+
+        // front line segment
+        m = _mm_and_ps(in_range, _mm_and_ps(_mm_cmpgt_ps(x, zero),
+                                            _mm_and_ps(_mm_cmple_ps(r_squared, front_diag),
+                                                       _mm_cmple_ps(front_sq_v, r_squared))));
+        yi = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(r_squared, front_sq_v), zero));
+        neg_yi = _mm_sub_ps(zero, yi);
+        const __m128 ahead = atan2_sse(yi, front);
+        mi = _mm_and_ps(m, _mm_and_ps(_mm_cmple_ps(neg_width, yi), _mm_cmple_ps(yi, width)));
+        check_angle_sse(theta, ahead, mi, left, right);
+        mi = _mm_and_ps(m, _mm_and_ps(_mm_cmple_ps(neg_width, neg_yi),
+                                      _mm_cmple_ps(neg_yi, width)));
+        check_angle_sse(theta, _mm_xor_ps(ahead, sign_mask), mi, left, right);
+    }
+
+    result.left = std::min(result.left, hmin_sse(left));
+    result.right = std::min(result.right, hmin_sse(right));
+
+    angle_points_scalar(fp, xs + i, ys + i, n - i, result);
+}
+
+__attribute__((target("avx2")))
+float hmin_avx(__m256 v)
+{
+    __m128 m = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+    return _mm_cvtss_f32(m);
+}
+
+__attribute__((target("avx2")))
+void dist_points_avx2(const Footprint& fp, const float* x, const float* y,
+                      size_t n, DistResult& result)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    const __m256 width = _mm256_set1_ps(fp.width);
+    const __m256 neg_width = _mm256_set1_ps(-fp.width);
+    const __m256 front = _mm256_set1_ps(fp.front_length);
+    const __m256 back = _mm256_set1_ps(fp.back_length);
+    const __m256 neg_back = _mm256_set1_ps(-fp.back_length);
+
+    __m256 forward = inf;
+    __m256 rear = inf;
+    __m256 left = inf;
+    __m256 right = inf;
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 xv = _mm256_loadu_ps(x + i);
+        const __m256 yv = _mm256_loadu_ps(y + i);
+        const __m256 neg_x = _mm256_sub_ps(zero, xv);
+        const __m256 neg_y = _mm256_sub_ps(zero, yv);
+
+        const __m256 in_width = _mm256_and_ps(_mm256_cmp_ps(neg_width, yv, _CMP_LT_OQ),
+                                              _mm256_cmp_ps(yv, width, _CMP_LT_OQ));
+        const __m256 in_length = _mm256_and_ps(_mm256_cmp_ps(neg_back, xv, _CMP_LT_OQ),
+                                               _mm256_cmp_ps(xv, front, _CMP_LT_OQ));
+
+        __m256 m = _mm256_and_ps(in_width, _mm256_cmp_ps(xv, front, _CMP_GT_OQ));
+        forward = _mm256_min_ps(forward, _mm256_blendv_ps(inf, xv, m));
+
+        m = _mm256_and_ps(in_width, _mm256_cmp_ps(neg_x, back, _CMP_GT_OQ));
+        rear = _mm256_min_ps(rear, _mm256_blendv_ps(inf, neg_x, m));
+
+        m = _mm256_and_ps(in_length, _mm256_cmp_ps(yv, zero, _CMP_GT_OQ));
+        left = _mm256_min_ps(left, _mm256_blendv_ps(inf, yv, m));
+
+        m = _mm256_and_ps(in_length, _mm256_cmp_ps(yv, zero, _CMP_LT_OQ));
+        right = _mm256_min_ps(right, _mm256_blendv_ps(inf, neg_y, m));
+    }
+
+    result.forward = std::min(result.forward, hmin_avx(forward));
+    result.rear = std::min(result.rear, hmin_avx(rear));
+    result.left = std::min(result.left, hmin_avx(left));
+    result.right = std::min(result.right, hmin_avx(right));
+
+    dist_points_scalar(fp, x + i, y + i, n - i, result);
+}
+
+__attribute__((target("avx2")))
+__m256 atan2_avx(__m256 y, __m256 x)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    const __m256 ax = _mm256_andnot_ps(sign_mask, x);
+    const __m256 ay = _mm256_andnot_ps(sign_mask, y);
+    const __m256 mn = _mm256_min_ps(ax, ay);
+    const __m256 mx = _mm256_max_ps(ax, ay);
+
+    __m256 z = _mm256_div_ps(mn, mx);
+    z = _mm256_blendv_ps(z, zero, _mm256_cmp_ps(mx, zero, _CMP_EQ_OQ));
+    const __m256 z2 = _mm256_mul_ps(z, z);
+
+    __m256 p = _mm256_set1_ps(-0.01172120f);
+    p = _mm256_add_ps(_mm256_mul_ps(p, z2), _mm256_set1_ps(0.05265332f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, z2), _mm256_set1_ps(-0.11643287f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, z2), _mm256_set1_ps(0.19354346f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, z2), _mm256_set1_ps(-0.33262347f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, z2), _mm256_set1_ps(0.99997726f));
+    __m256 a = _mm256_mul_ps(p, z);
+
+    // restore the octant, blendv selects on the sign bit of x
+    a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps(half_pi), a), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+    a = _mm256_blendv_ps(a, _mm256_sub_ps(_mm256_set1_ps(pi), a), x);
+    return _mm256_or_ps(a, _mm256_and_ps(sign_mask, y));
+}
+
+// Fold the rotation from bearing theta to phi into left and right
+__attribute__((target("avx2")))
+inline void check_angle_avx(__m256 theta, __m256 phi, __m256 mask,
+                            __m256& left, __m256& right)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    const __m256 two_pi_v = _mm256_set1_ps(two_pi);
+
+    __m256 t = _mm256_sub_ps(theta, phi);
+    t = _mm256_add_ps(t, _mm256_and_ps(_mm256_cmp_ps(t, _mm256_set1_ps(-pi), _CMP_LT_OQ), two_pi_v));
+    t = _mm256_sub_ps(t, _mm256_and_ps(_mm256_cmp_ps(t, _mm256_set1_ps(pi), _CMP_GT_OQ), two_pi_v));
+
+    __m256 m = _mm256_and_ps(mask, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+    left = _mm256_min_ps(left, _mm256_blendv_ps(inf, t, m));
+
+    m = _mm256_and_ps(mask, _mm256_cmp_ps(t, zero, _CMP_LT_OQ));
+    right = _mm256_min_ps(right, _mm256_blendv_ps(inf, _mm256_sub_ps(zero, t), m));
+
+    const __m256 abs_t = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), t);
+    m = _mm256_and_ps(mask, _mm256_cmp_ps(abs_t, _mm256_set1_ps(contact_angle), _CMP_LT_OQ));
+    left = _mm256_min_ps(left, _mm256_blendv_ps(inf, zero, m));
+    right = _mm256_min_ps(right, _mm256_blendv_ps(inf, zero, m));
+}
+
+__attribute__((target("avx2")))
+void angle_points_avx2(const Footprint& fp, const float* xs, const float* ys,
+                        size_t n, AngleResult& result)
+{
+    const float width_sq = fp.width * fp.width;
+    const float front_sq = fp.front_length * fp.front_length;
+    const float back_sq = fp.back_length * fp.back_length;
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    const __m256 pi_v = _mm256_set1_ps(pi);
+    const __m256 width = _mm256_set1_ps(fp.width);
+    const __m256 neg_width = _mm256_set1_ps(-fp.width);
+    const __m256 front = _mm256_set1_ps(fp.front_length);
+    const __m256 neg_back = _mm256_set1_ps(-fp.back_length);
+    const __m256 width_sq_v = _mm256_set1_ps(width_sq);
+    const __m256 front_sq_v = _mm256_set1_ps(front_sq);
+    const __m256 back_sq_v = _mm256_set1_ps(back_sq);
+    const __m256 front_diag = _mm256_set1_ps(width_sq + front_sq);
+    const __m256 back_diag = _mm256_set1_ps(width_sq + back_sq);
+
+    __m256 left = inf;
+    __m256 right = inf;
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 x = _mm256_loadu_ps(xs + i);
+        const __m256 y = _mm256_loadu_ps(ys + i);
+        const __m256 r_squared = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+        const __m256 in_range = _mm256_cmp_ps(r_squared, back_diag, _CMP_LE_OQ);
+        if (_mm256_movemask_ps(in_range) == 0) {
+            continue;
+        }
+        const __m256 theta = atan2_avx(y, x);
+
+        // left and right line segments
+        __m256 m = _mm256_and_ps(in_range, _mm256_cmp_ps(width_sq_v, r_squared, _CMP_LE_OQ));
+        const __m256 xi = _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(r_squared, width_sq_v), zero));
+        const __m256 neg_xi = _mm256_sub_ps(zero, xi);
+        const __m256 side = atan2_avx(width, xi);
+        const __m256 side_back = _mm256_sub_ps(pi_v, side);
+        __m256 mi = _mm256_and_ps(m, _mm256_and_ps(_mm256_cmp_ps(neg_back, xi, _CMP_LE_OQ),
+                                             _mm256_cmp_ps(xi, front, _CMP_LE_OQ)));
+        check_angle_avx(theta, side, mi, left, right);
+        check_angle_avx(theta, _mm256_xor_ps(side, sign_mask), mi, left, right);
+        mi = _mm256_and_ps(m, _mm256_and_ps(_mm256_cmp_ps(neg_back, neg_xi, _CMP_LE_OQ),
+                                      _mm256_cmp_ps(neg_xi, front, _CMP_LE_OQ)));
+        check_angle_avx(theta, side_back, mi, left, right);
+        check_angle_avx(theta, _mm256_xor_ps(side_back, sign_mask), mi, left, right);
+
+        // back line segment
+        m = _mm256_and_ps(in_range, _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_LT_OQ),
+                                            _mm256_cmp_ps(back_sq_v, r_squared, _CMP_LE_OQ)));
+        __m256 yi = _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(r_squared, back_sq_v), zero));
+        __m256 neg_yi = _mm256_sub_ps(zero, yi);
+        const __m256 rear = atan2_avx(yi, neg_back);
+        mi = _mm256_and_ps(m, _mm256_and_ps(_mm256_cmp_ps(neg_width, yi, _CMP_LE_OQ), _mm256_cmp_ps(yi, width, _CMP_LE_OQ)));
+        check_angle_avx(theta, rear, mi, left, right);
+        mi = _mm256_and_ps(m, _mm256_and_ps(_mm256_cmp_ps(neg_width, neg_yi, _CMP_LE_OQ),
+                                      _mm256_cmp_ps(neg_yi, width, _CMP_LE_OQ)));
+        check_angle_avx(theta, _mm256_xor_ps(rear, sign_mask), mi, left, right);
+
+        // front line segment
+        m = _mm256_and_ps(in_range, _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GT_OQ),
+                                            _mm256_and_ps(_mm256_cmp_ps(r_squared, front_diag, _CMP_LE_OQ),
+                                                       _mm256_cmp_ps(front_sq_v, r_squared, _CMP_LE_OQ))));
+        yi = _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(r_squared, front_sq_v), zero));
+        neg_yi = _mm256_sub_ps(zero, yi);
+        const __m256 ahead = atan2_avx(yi, front);
+        mi = _mm256_and_ps(m, _mm256_and_ps(_mm256_cmp_ps(neg_width, yi, _CMP_LE_OQ), _mm256_cmp_ps(yi, width, _CMP_LE_OQ)));
+        check_angle_avx(theta, ahead, mi, left, right);
+        mi = _mm256_and_ps(m, _mm256_and_ps(_mm256_cmp_ps(neg_width, neg_yi, _CMP_LE_OQ),
+                                      _mm256_cmp_ps(neg_yi, width, _CMP_LE_OQ)));
+        check_angle_avx(theta, _mm256_xor_ps(ahead, sign_mask), mi, left, right);
+    }
+
+    result.left = std::min(result.left, hmin_avx(left));
+    result.right = std::min(result.right, hmin_avx(right));
+
+    angle_points_scalar(fp, xs + i, ys + i, n - i, result);
+}
+
+#endif
+
+// Fill in k with the named implementation, or the fastest one if name
+// is null, returns false if the CPU doesn't support it
+bool select_kernels(const char* name, Kernels& k)
+{
+    if (!name || strcmp(name, "scalar") == 0) {
+        k.dist_points = dist_points_scalar;
+        k.angle_points = angle_points_scalar;
+        k.name = "scalar";
+    }
+
+#ifdef COLLISION_KERNELS_X86
+    __builtin_cpu_init();
+    if ((!name || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2")) {
+        k.dist_points = dist_points_avx2;
+        k.angle_points = angle_points_avx2;
+        k.name = "avx2";
+        return true;
+    }
+    if ((!name || strcmp(name, "sse4.1") == 0) && __builtin_cpu_supports("sse4.1")) {
+        k.dist_points = dist_points_sse41;
+        k.angle_points = angle_points_sse41;
+        k.name = "sse4.1";
+        return true;
+    }
+#endif
+
+    return !name || strcmp(name, "scalar") == 0;
+}
+
+Kernels& kernels()
+{
+    static Kernels k = [] {
+        Kernels best;
+        select_kernels(nullptr, best);
+        return best;
+    }();
+    return k;
+}
+
+}
+
+void dist_points(const Footprint& footprint, const float* x, const float* y,
+                 size_t n, DistResult& result)
+{
+    kernels().dist_points(footprint, x, y, n, result);
+}
+
+void angle_points(const Footprint& footprint, const float* x, const float* y,
+                  size_t n, AngleResult& result)
+{
+    kernels().angle_points(footprint, x, y, n, result);
+}
+
+void arc_points(const Arc& arc, const float* x, const float* y,
+                size_t n, float& closest)
+{
+    for (size_t i = 0; i < n; i++) {
+        // Transform the obstacle point into the coordinate system with the
+        // point of rotation at the origin, with the same orientation as base_link
+        const float p_x = x[i];
+        const float p_y = y[i] - arc.centre_y;
+        // Radius for polar coordinates around center of rotation
+        const float p_radius_sq = p_x * p_x + p_y * p_y;
+
+        if (p_radius_sq >= arc.outer_radius_sq || p_radius_sq <= arc.inner_radius_sq) {
+            continue;
+        }
+
+        // Angle for polar coordinates around center of rotation
+        const float p_theta = std::atan2(p_y, p_x);
+
+        // Make sure that the angle is relevant and not behind the robot
+        bool relevant;
+        if (arc.forward) {
+            relevant = arc.left ? p_theta > arc.outer_theta : p_theta < arc.outer_theta;
+        }
+        else {
+            const float angle = p_theta < 0 ? p_theta + two_pi : p_theta;
+            relevant = arc.left ? angle < arc.outer_theta : angle > arc.outer_theta;
+        }
+
+        if (relevant && p_theta < pi) {
+            // TODO: This assumes that any collision with the point will be
+            // on the leading part of the robot, when in reality we can turn more
+            // than this amount if the point only causes a collision with the rear
+            // part of the robot as it swings around for a turn
+            closest = std::min(closest, p_theta);
+        }
+    }
+}
+
+const char* implementation()
+{
+    return kernels().name;
+}
+
+bool set_implementation(const char* name)
+{
+    Kernels k;
+    if (!select_kernels(name, k)) {
+        return false;
+    }
+    kernels() = k;
+    return true;
+}
+
+}
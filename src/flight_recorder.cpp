@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include "move_smooth/flight_recorder.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+static_assert(sizeof(FlightRecord) == 72, "FlightRecord is part of the file format");
+static_assert(sizeof(FlightHeader) == 160, "FlightHeader is part of the file format");
+
+namespace
+{
+
+std::atomic<bool> signalled(false);
+
+void on_signal(int)
+{
+    signalled.store(true);
+}
+
+}
+
+FlightRecorder::FlightRecorder(size_t capacity) : records(std::max<size_t>(capacity, 1)),
+                                                  written(0)
+{
+}
+
+void FlightRecorder::record(const FlightRecord& record)
+{
+    const std::lock_guard<std::mutex> lock(mutex);
+    records[written % records.size()] = record;
+    written++;
+}
+
+bool FlightRecorder::dump(const std::string& path, uint32_t goal, double stamp,
+                          const std::string& reason)
+{
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    const std::lock_guard<std::mutex> lock(mutex);
+    size_t count = std::min<uint64_t>(written, records.size());
+    size_t size = sizeof(FlightHeader) + count * sizeof(FlightRecord);
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        return false;
+    }
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    FlightHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "MSFLIGHT", sizeof(header.magic));
+    header.version = FlightHeader::current_version;
+    header.record_size = sizeof(FlightRecord);
+    header.count = count;
+    header.goal = goal;
+    header.stamp = stamp;
+    strncpy(header.reason, reason.c_str(), sizeof(header.reason) - 1);
+    memcpy(map, &header, sizeof(header));
+
+    // Unwrap the ring, oldest first
+    FlightRecord* out = reinterpret_cast<FlightRecord*>(static_cast<char*>(map) + sizeof(header));
+    size_t first = (written - count) % records.size();
+    size_t tail = std::min(count, records.size() - first);
+    std::copy(records.begin() + first, records.begin() + first + tail, out);
+    std::copy(records.begin(), records.begin() + (count - tail), out + tail);
+
+    bool ok = msync(map, size, MS_SYNC) == 0;
+    munmap(map, size);
+    return ok;
+}
+
+void FlightRecorder::dump_on_signal(int signal)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(signal, &action, nullptr);
+}
+
+bool FlightRecorder::signal_pending()
+{
+    return signalled.exchange(false);
+}
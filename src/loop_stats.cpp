@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include "move_smooth/loop_stats.h"
+
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include <cmath>
+#include <cstdio>
+
+LatencyHistogram::LatencyHistogram() : total(0), sum(0), maximum(0), over_budget(0), budget(0)
+{
+    for (auto& count : counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+int LatencyHistogram::bucket_of(uint64_t ns)
+{
+    if (ns < (uint64_t) linear_limit) {
+        return (int) ns;
+    }
+    int magnitude = 63 - __builtin_clzll(ns);
+    int sub_bucket = (int) (ns >> (magnitude - sub_bucket_bits)) - sub_buckets;
+    int bucket = linear_limit + (magnitude - sub_bucket_bits - 1) * sub_buckets + sub_bucket;
+    return std::min(bucket, buckets - 1);
+}
+
+// Middle of the bucket
+uint64_t LatencyHistogram::value_of(int bucket)
+{
+    if (bucket < linear_limit) {
+        return bucket;
+    }
+    int magnitude = (bucket - linear_limit) / sub_buckets + sub_bucket_bits + 1;
+    int sub_bucket = (bucket - linear_limit) % sub_buckets;
+    int shift = magnitude - sub_bucket_bits;
+    return ((uint64_t) (sub_buckets + sub_bucket) << shift) + ((uint64_t) 1 << (shift - 1));
+}
+
+void LatencyHistogram::record(uint64_t ns)
+{
+    counts[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t previous = maximum.load(std::memory_order_relaxed);
+    while (ns > previous &&
+           !maximum.compare_exchange_weak(previous, ns, std::memory_order_relaxed)) {
+    }
+    if (budget && ns > budget) {
+        over_budget.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+double LatencyHistogram::mean_us() const
+{
+    uint64_t n = count();
+    return n ? sum.load(std::memory_order_relaxed) / 1000.0 / n : 0.0;
+}
+
+double LatencyHistogram::max_us() const
+{
+    return maximum.load(std::memory_order_relaxed) / 1000.0;
+}
+
+double LatencyHistogram::percentile_us(double p) const
+{
+    uint64_t n = count();
+    if (n == 0) {
+        return 0.0;
+    }
+    uint64_t target = std::max<uint64_t>(1, (uint64_t) std::ceil(p * n));
+    uint64_t seen = 0;
+    for (int i = 0; i < buckets; i++) {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen >= target) {
+            return std::min(value_of(i) / 1000.0, max_us());
+        }
+    }
+    return max_us();
+}
+
+LoopStats::LoopStats()
+{
+    for (auto& overruns : published_overruns) {
+        overruns = 0;
+    }
+}
+
+const char* LoopStats::name(Stage stage)
+{
+    switch (stage) {
+        case follow_cycle: return "follow_cycle";
+        case rotate_cycle: return "rotate_cycle";
+        case run_cycle: return "run_cycle";
+        case wake_lateness: return "wake_lateness";
+        case tf_lookup: return "tf_lookup";
+        case obstacle_fetch: return "obstacle_fetch";
+        case clearance_query: return "clearance_query";
+        case command_publish: return "command_publish";
+        case stop_latency: return "stop_latency";
+        default: return "unknown";
+    }
+}
+
+static diagnostic_msgs::KeyValue key_value(const char* key, double value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.1f", value);
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = text;
+    return kv;
+}
+
+void LoopStats::publish(ros::Publisher& pub, const ros::Time& stamp)
+{
+    diagnostic_msgs::DiagnosticArray msg;
+    msg.header.stamp = stamp;
+    for (int i = 0; i < stages; i++) {
+        const LatencyHistogram& h = histograms[i];
+        if (h.count() == 0) {
+            continue;
+        }
+
+        diagnostic_msgs::DiagnosticStatus status;
+        status.name = std::string("move_smooth: ") + name((Stage) i);
+        uint64_t overruns = h.overruns();
+        if (overruns > published_overruns[i]) {
+            status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+            status.message = std::to_string(overruns - published_overruns[i]) + " overruns";
+        }
+        else {
+            status.level = diagnostic_msgs::DiagnosticStatus::OK;
+            status.message = "OK";
+        }
+        published_overruns[i] = overruns;
+
+        status.values.push_back(key_value("count", h.count()));
+        status.values.push_back(key_value("mean_us", h.mean_us()));
+        status.values.push_back(key_value("p50_us", h.percentile_us(0.5)));
+        status.values.push_back(key_value("p90_us", h.percentile_us(0.9)));
+        status.values.push_back(key_value("p99_us", h.percentile_us(0.99)));
+        status.values.push_back(key_value("p999_us", h.percentile_us(0.999)));
+        status.values.push_back(key_value("max_us", h.max_us()));
+        status.values.push_back(key_value("overruns", overruns));
+        msg.status.push_back(status);
+    }
+    pub.publish(msg);
+}
+
+std::string LoopStats::dump() const
+{
+    std::string text;
+    char line[160];
+    snprintf(line, sizeof(line), "%-16s %10s %10s %10s %10s %10s %10s %10s %9s\n",
+             "stage", "count", "mean_us", "p50_us", "p90_us", "p99_us", "p999_us", "max_us",
+             "overruns");
+    text += line;
+    for (int i = 0; i < stages; i++) {
+        const LatencyHistogram& h = histograms[i];
+        snprintf(line, sizeof(line), "%-16s %10lu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %9lu\n",
+                 name((Stage) i), (unsigned long) h.count(), h.mean_us(), h.percentile_us(0.5),
+                 h.percentile_us(0.9), h.percentile_us(0.99), h.percentile_us(0.999), h.max_us(),
+                 (unsigned long) h.overruns());
+        text += line;
+    }
+    return text;
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include "move_smooth/motion_profile.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Whether speed can change from v0 to v1 within distance, Biagiotti and
+// Melchiorri (3.31) and (3.32)
+static bool feasible(double distance, double v0, double v1,
+                     double max_acceleration, double max_jerk)
+{
+    double tj = std::min(std::sqrt(std::abs(v1 - v0) / max_jerk),
+                         max_acceleration / max_jerk);
+    if (tj < max_acceleration / max_jerk) {
+        return distance > tj * (v0 + v1);
+    }
+    return distance > 0.5 * (v0 + v1) * (tj + std::abs(v1 - v0) / max_acceleration);
+}
+
+MotionProfile::MotionProfile() : planned(false), distance(0.0)
+{
+    for (int i = 0; i <= phases; i++) {
+        start[i] = position[i] = velocity[i] = acceleration[i] = 0.0;
+    }
+    for (int i = 0; i < phases; i++) {
+        jerk[i] = 0.0;
+    }
+}
+
+void MotionProfile::plan(double distance, double start_velocity, double end_velocity,
+                         double max_velocity, double max_acceleration, double max_jerk)
+{
+    double v0 = std::max(0.0, std::min(start_velocity, max_velocity));
+    double v1 = std::max(0.0, std::min(end_velocity, max_velocity));
+    this->distance = std::max(distance, 0.0);
+
+    double durations[phases] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    double jerks[phases] = {max_jerk, 0.0, -max_jerk, 0.0, -max_jerk, 0.0, max_jerk};
+
+    if (this->distance > 0.0 && max_velocity > 0.0 &&
+        max_acceleration > 0.0 && max_jerk > 0.0) {
+        // Move the end speed towards the start speed until it is reachable
+        if (!feasible(this->distance, v0, v1, max_acceleration, max_jerk)) {
+            double reachable = v0;
+            double unreachable = v1;
+            for (int i = 0; i < 30; i++) {
+                double v = 0.5 * (reachable + unreachable);
+                if (feasible(this->distance, v0, v, max_acceleration, max_jerk)) {
+                    reachable = v;
+                }
+                else {
+                    unreachable = v;
+                }
+            }
+            v1 = reachable;
+        }
+
+        if (!solve(this->distance, v0, v1, max_velocity, max_acceleration, max_jerk,
+                   durations)) {
+            // The distance is too short for the speed to change, cover it at
+            // a constant speed, only starting from rest is that a jump
+            for (int i = 0; i < phases; i++) {
+                durations[i] = 0.0;
+            }
+            if (v0 <= 0.0) {
+                v0 = 0.5 * max_velocity;
+            }
+            v1 = v0;
+            durations[3] = this->distance / v0;
+        }
+    }
+    else {
+        // No room to change speed
+        v1 = v0;
+    }
+
+    // Integrate the phases
+    start[0] = 0.0;
+    position[0] = 0.0;
+    velocity[0] = v0;
+    acceleration[0] = 0.0;
+    for (int i = 0; i < phases; i++) {
+        double t = durations[i];
+        jerk[i] = jerks[i];
+        start[i + 1] = start[i] + t;
+        position[i + 1] = position[i] + velocity[i] * t + acceleration[i] * t * t / 2.0 +
+                          jerk[i] * t * t * t / 6.0;
+        velocity[i + 1] = velocity[i] + acceleration[i] * t + jerk[i] * t * t / 2.0;
+        acceleration[i + 1] = acceleration[i] + jerk[i] * t;
+    }
+    acceleration[phases] = 0.0;
+    velocity[phases] = v1;
+    planned = true;
+}
+
+// Durations of the seven phases, Biagiotti and Melchiorri section 3.4.2
+
+bool MotionProfile::solve(double distance, double v0, double v1, double max_velocity,
+                          double max_acceleration, double max_jerk, double durations[phases])
+{
+    const double h = distance;
+    const double jmax = max_jerk;
+    double amax = max_acceleration;
+
+    for (int iteration = 0; iteration < 1000; iteration++) {
+        double tj1, ta, tj2, td, tv;
+
+        // Assume that the maximum speed is reached
+        if ((max_velocity - v0) * jmax < amax * amax) {
+            tj1 = std::sqrt((max_velocity - v0) / jmax);
+            ta = 2.0 * tj1;
+        }
+        else {
+            tj1 = amax / jmax;
+            ta = tj1 + (max_velocity - v0) / amax;
+        }
+        if ((max_velocity - v1) * jmax < amax * amax) {
+            tj2 = std::sqrt((max_velocity - v1) / jmax);
+            td = 2.0 * tj2;
+        }
+        else {
+            tj2 = amax / jmax;
+            td = tj2 + (max_velocity - v1) / amax;
+        }
+        tv = h / max_velocity - ta / 2.0 * (1.0 + v0 / max_velocity) -
+                                td / 2.0 * (1.0 + v1 / max_velocity);
+
+        if (tv < 0.0) {
+            // It isn't
+            tv = 0.0;
+            double tj = amax / jmax;
+            tj1 = tj2 = tj;
+            double delta = std::pow(amax, 4) / (jmax * jmax) + 2.0 * (v0 * v0 + v1 * v1) +
+                           amax * (4.0 * h - 2.0 * amax / jmax * (v0 + v1));
+            ta = (amax * amax / jmax - 2.0 * v0 + std::sqrt(delta)) / (2.0 * amax);
+            td = (amax * amax / jmax - 2.0 * v1 + std::sqrt(delta)) / (2.0 * amax);
+
+            if (ta < 0.0) {
+                // Only slowing down
+                ta = tj1 = 0.0;
+                td = 2.0 * h / (v1 + v0);
+                tj2 = (jmax * h - std::sqrt(jmax * (jmax * h * h + (v1 + v0) * (v1 + v0) * (v1 - v0)))) /
+                      (jmax * (v1 + v0));
+            }
+            else if (td < 0.0) {
+                // Only speeding up
+                td = tj2 = 0.0;
+                ta = 2.0 * h / (v1 + v0);
+                tj1 = (jmax * h - std::sqrt(jmax * (jmax * h * h - (v1 + v0) * (v1 + v0) * (v1 - v0)))) /
+                      (jmax * (v1 + v0));
+            }
+            else if (ta < 2.0 * tj || td < 2.0 * tj) {
+                // The maximum acceleration isn't reached either
+                amax *= 0.99;
+                continue;
+            }
+        }
+
+        durations[0] = tj1;
+        durations[1] = ta - 2.0 * tj1;
+        durations[2] = tj1;
+        durations[3] = tv;
+        durations[4] = tj2;
+        durations[5] = td - 2.0 * tj2;
+        durations[6] = tj2;
+        for (int i = 0; i < phases; i++) {
+            if (!std::isfinite(durations[i]) || durations[i] < -1e-9) {
+                return false;
+            }
+            durations[i] = std::max(durations[i], 0.0);
+        }
+        return true;
+    }
+    return false;
+}
+
+int MotionProfile::phase_at(double t) const
+{
+    int i = 0;
+    while (i < phases - 1 && t >= start[i + 1]) {
+        i++;
+    }
+    return i;
+}
+
+double MotionProfile::position_at(double t) const
+{
+    if (t >= start[phases]) {
+        return position[phases] + velocity[phases] * (t - start[phases]);
+    }
+    t = std::max(t, 0.0);
+    int i = phase_at(t);
+    double dt = t - start[i];
+    return position[i] + velocity[i] * dt + acceleration[i] * dt * dt / 2.0 +
+           jerk[i] * dt * dt * dt / 6.0;
+}
+
+double MotionProfile::velocity_at(double t) const
+{
+    if (t >= start[phases]) {
+        return velocity[phases];
+    }
+    t = std::max(t, 0.0);
+    int i = phase_at(t);
+    double dt = t - start[i];
+    return velocity[i] + acceleration[i] * dt + jerk[i] * dt * dt / 2.0;
+}
+
+double MotionProfile::acceleration_at(double t) const
+{
+    if (t >= start[phases]) {
+        return 0.0;
+    }
+    t = std::max(t, 0.0);
+    int i = phase_at(t);
+    return acceleration[i] + jerk[i] * (t - start[i]);
+}
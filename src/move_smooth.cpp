@@ -30,6 +30,7 @@
  */
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <tf2/LinearMath/Transform.h>
 #include <tf2_ros/buffer.h>
 #include <tf2_ros/transform_listener.h>
@@ -47,30 +48,72 @@
 #include <move_base_msgs/MoveBaseAction.h>
 
 #include "move_smooth/collision_checker.h"
+#include "move_smooth/clearance_worker.h"
 #include "move_smooth/queued_action_server.h"
+#include "move_smooth/alloc_counter.h"
+#include "move_smooth/update_trigger.h"
+#include "move_smooth/pose_provider.h"
+#include "move_smooth/motion_profile.h"
+#include "move_smooth/loop_stats.h"
+#include "move_smooth/trace.h"
+#include "move_smooth/flight_recorder.h"
+#include "move_smooth/clock.h"
+#include "move_smooth/runaway_check.h"
 #include <move_smooth/MovesmoothConfig.h>
 #include <move_smooth/Stop.h>
+#include <move_smooth/FollowPathAction.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <std_srvs/Trigger.h>
 
 #include <assert.h>
 #include <string>
 #include <condition_variable>
 #include <mutex>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <pthread.h>
+#include <signal.h>
 
 typedef actionlib::QueuedActionServer<move_base_msgs::MoveBaseAction> MoveBaseActionServer;
+typedef actionlib::SimpleActionServer<move_smooth::FollowPathAction> FollowPathActionServer;
 
 class MoveBasic {
   private:
+    // Time for the control loops and everything they use
+    const Clock& clock;
+
+    // Callbacks are split over queues served by their own spinner
+    // threads, so that a slow sensor callback can't hold up goals or
+    // services
+    ros::CallbackQueue sensorQueue;
+    ros::CallbackQueue controlQueue;
+    ros::CallbackQueue serviceQueue;
+
     ros::Subscriber goalSub;
+    ros::Subscriber pathSub;
+    ros::ServiceServer stopServer;
+    ros::ServiceServer statsServer;
+    ros::ServiceServer traceServer;
 
     ros::Publisher goalPub;
+    ros::Publisher pathGoalPub;
     ros::Publisher cmdPub;
     ros::Publisher pathPub;
     ros::Publisher obstacle_dist_pub;
+    ros::Publisher diagnosticsPub;
 
     std::unique_ptr<MoveBaseActionServer> actionServer;
+    std::unique_ptr<FollowPathActionServer> pathServer;
     std::unique_ptr<CollisionChecker> collision_checker;
     std::unique_ptr<ObstaclePoints> obstacle_points;
+    std::unique_ptr<ClearanceWorker> clearance_worker;
+    std::unique_ptr<PoseProvider> pose_provider;
+    std::unique_ptr<FlightRecorder> flight_recorder;
 
     tf2_ros::Buffer tfBuffer;
     tf2_ros::TransformListener listener;
@@ -85,6 +128,17 @@ class MoveBasic {
     double maxLinearVelocity;
     double minLinearVelocity;
     double maxLinearAcceleration;
+
+    // Jerk limited velocity profiles, not used if the jerk limit is 0.
+    // They are replanned when the robot is further than the given
+    // distance or angle from them, or the speed at the goal changes.
+    double maxLinearJerk;
+    double maxAngularJerk;
+    double profileReplanDistance;
+    double profileReplanAngle;
+    double profileReplanVelocity;
+    MotionProfile linearProfile;
+    MotionProfile angularProfile;
     double angleTolerance;
     double linearTolerance;
 
@@ -92,32 +146,106 @@ class MoveBasic {
     double gravityConstant;
     double maxLateralDev;
 
-    int goalId;
-    bool stop;
+    // Pending goals, and how many of them the velocity planner looks at
+    int goalQueueLength;
+    int goalLookahead;
+    std::vector<tf2::Vector3> lookaheadPoints;
+
+    // Goals are executed one at a time, either a move_base goal or a
+    // whole path. A path is transformed into the driving frame up front.
+    // Each server runs one goal at a time, so a goal waiting for
+    // executeMutex is for the other server, and preempts the running one.
+    std::mutex executeMutex;
+    std::atomic<int> executeWaiting;
+    bool followingPath;
+    std::vector<tf2::Transform> pathInDriving;
+    size_t pathIndex;
+
+    // Ids of the goals made from simple goal and path messages, which
+    // can arrive on more than one control thread
+    std::atomic<int> goalId;
+
+    // Emergency stop, latched by the stop service. cmdMutex orders
+    // commands against it so that once the service has published the
+    // zero command, nothing else gets through.
+    std::atomic<bool> stop;
+    std::mutex cmdMutex;
+    geometry_msgs::Twist stopMsg;
+    int stopThreadPriority;
 
     double lateralKp;
     double lateralKi;
     double lateralKd;
 
     double runawayTimeoutSecs;
+    RunawayCheck runaway;
 
     double forwardObstacleThreshold;
 
     double minSideDist;
 
-    float forwardObstacleDist;
-    float leftObstacleDist;
-    float rightObstacleDist;
-    tf2::Vector3 forwardLeft;
-    tf2::Vector3 forwardRight;
-
-    dynamic_reconfigure::Server<move_smooth::MovesmoothConfig> dr_srv;
+    // Outgoing messages, reused so that the control loops don't allocate
+    geometry_msgs::Twist cmdMsg;
+    geometry_msgs::Vector3 obstacleDistMsg;
+
+    AllocationCheck runCheck;
+    AllocationCheck rotateCheck;
+    AllocationCheck followCheck;
+
+    // Event driven control: a step runs when new odometry or obstacle
+    // data arrives, or at the watchdog rate if nothing does
+    bool eventDriven;
+    ros::WallDuration watchdogPeriod;
+    UpdateTrigger updateTrigger;
+    LatencyMonitor latency;
+
+    // Timings of the control loops, published as diagnostics
+    LoopStats stats;
+
+    // Control state for the flight recorder, filled in by the loops and
+    // recorded with each command
+    FlightRecord flightState;
+    std::atomic<uint32_t> flightGoal;
+    std::string flightFile;
+    ros::WallDuration diagnosticsPeriod;
+    ros::Time lastWake;
+    std::string traceFile;
+
+    // Declared last so that they are stopped first
+    std::unique_ptr<ros::AsyncSpinner> sensorSpinner;
+    std::unique_ptr<ros::AsyncSpinner> controlSpinner;
+    // Services run on their own thread, at a raised priority so that a
+    // stop gets through even when the cores are busy
+    std::atomic<bool> servicesRunning;
+    std::thread serviceThread;
+
+    void serviceLoop();
+
+    std::unique_ptr<dynamic_reconfigure::Server<move_smooth::MovesmoothConfig>> dr_srv;
+    // Reconfigure runs on the control queue while goals execute on the
+    // action server threads, so a new config is handed over under
+    // configMutex and taken up by the execute thread between cycles
+    std::mutex configMutex;
+    move_smooth::MovesmoothConfig pendingConfig;
+    std::atomic<bool> configPending;
 
     void dynamicReconfigCallback(move_smooth::MovesmoothConfig& config, uint32_t level);
+    void applyConfig();
     void goalCallback(const geometry_msgs::PoseStamped::ConstPtr& msg);
+    void pathCallback(const nav_msgs::Path::ConstPtr& msg);
+    void waitForUpdate(ClockRate& r, uint64_t& seen);
+    std::shared_ptr<const Clearance> getClearance();
     void executeAction(const move_base_msgs::MoveBaseGoalConstPtr& goal);
+    void executePath(const move_smooth::FollowPathGoalConstPtr& goal);
+    bool getDrivingFrame(std::string& drivingFrame, tf2::Transform& currentDrivingBase);
+    bool isNextGoalAvailable();
+    bool isPreemptRequested();
+    void setPreempted();
     void sendCmd(double angular, double linear);
     void abortGoal(const std::string msg);
+    void setFlightState(uint8_t mode, const tf2::Transform& poseDriving,
+                        double distance, double angle, const Clearance& clearance);
+    void dumpFlightRecord(const std::string& reason);
 
     double limitLinearVelocity(const double& velocity);
     double limitAngularVelocity(const double& velocity);
@@ -127,7 +255,8 @@ class MoveBasic {
                        const tf2::Transform& in, tf2::Transform& out);
 
   public:
-    MoveBasic();
+    explicit MoveBasic(const Clock& clock = Clock::ros_clock());
+    ~MoveBasic();
 
     void run();
 
@@ -137,8 +266,18 @@ class MoveBasic {
     bool smoothFollow(const std::string& drivingFrame,
                       tf2::Transform& goalInDriving);
 
+    double cornerVelocity(double angle);
+    bool queuedGoalVelocity(const std::string& drivingFrame,
+                            const tf2::Transform& poseDriving,
+                            const tf2::Transform& goalInDriving,
+                            double& velocity, double& distanceToNextGoal);
+
     bool stopService(move_smooth::Stop::Request &req,
                      move_smooth::Stop::Response &);
+    bool statsService(std_srvs::Trigger::Request &,
+                      std_srvs::Trigger::Response &res);
+    bool traceService(std_srvs::Trigger::Request &,
+                      std_srvs::Trigger::Response &res);
 };
 
 
@@ -183,8 +322,15 @@ static void getPose(const tf2::Transform& tf, double& x, double& y, double& yaw)
 
 
 // Constructor
-MoveBasic::MoveBasic(): tfBuffer(ros::Duration(3.0)),
-                        listener(tfBuffer)
+MoveBasic::MoveBasic(const Clock& clock): clock(clock),
+                                          tfBuffer(ros::Duration(3.0)),
+                                          listener(tfBuffer),
+                                          runaway(clock),
+                                          runCheck("run"),
+                                          rotateCheck("rotate"),
+                                          followCheck("smoothFollow"),
+                                          latency("MoveSmooth", 10.0, clock),
+                                          servicesRunning(false)
 {
     ros::NodeHandle nh("~");
     nh.param<double>("max_angular_velocity", maxAngularVelocity, 2.0);
@@ -193,6 +339,11 @@ MoveBasic::MoveBasic(): tfBuffer(ros::Duration(3.0)),
     nh.param<double>("max_linear_velocity", maxLinearVelocity, 0.5);
     nh.param<double>("min_linear_velocity", minLinearVelocity, 0.1);
     nh.param<double>("linear_acceleration", maxLinearAcceleration, 1.1);
+    nh.param<double>("max_linear_jerk", maxLinearJerk, 1.0);
+    nh.param<double>("max_angular_jerk", maxAngularJerk, 4.0);
+    nh.param<double>("profile_replan_distance", profileReplanDistance, 0.05);
+    nh.param<double>("profile_replan_angle", profileReplanAngle, 0.05);
+    nh.param<double>("profile_replan_velocity", profileReplanVelocity, 0.05);
     nh.param<double>("angular_tolerance", angleTolerance, 0.1);
     nh.param<double>("angular_tolerance", linearTolerance, 0.1);
 
@@ -207,6 +358,14 @@ MoveBasic::MoveBasic(): tfBuffer(ros::Duration(3.0)),
     // Maximum lateral deviation from the path
     nh.param<double>("max_lateral_deviation", maxLateralDev, 1.0);
 
+    // Goals that can wait behind the current one, and how many of them
+    // are considered when working out the speed through a corner
+    nh.param<int>("goal_queue_length", goalQueueLength, 1);
+    nh.param<int>("goal_lookahead", goalLookahead, 4);
+    goalQueueLength = std::max(goalQueueLength, 1);
+    goalLookahead = std::max(goalLookahead, 1);
+    lookaheadPoints.reserve(goalLookahead + 1);
+
     // Minimum distance to maintain at each side
     nh.param<double>("min_side_dist", minSideDist, 0.3);
 
@@ -221,13 +380,37 @@ MoveBasic::MoveBasic(): tfBuffer(ros::Duration(3.0)),
                           alternateDrivingFrame, "odom");
     nh.param<std::string>("base_frame", baseFrame, "base_link");
 
+    // Run the control loops on data arrival rather than at a fixed rate
+    nh.param<bool>("event_driven", eventDriven, false);
+    double watchdogRate;
+    nh.param<double>("watchdog_rate", watchdogRate, 10.0);
+    watchdogPeriod = ros::WallDuration(1.0 / std::max(watchdogRate, 1.0));
+
+    // Spinner threads for each callback queue
+    int sensorThreads, controlThreads;
+    nh.param<int>("sensor_threads", sensorThreads, 2);
+    nh.param<int>("control_threads", controlThreads, 1);
+    // SCHED_FIFO priority of the service thread, 0 to leave it alone
+    nh.param<int>("stop_thread_priority", stopThreadPriority, 80);
+
+    ros::NodeHandle sensorNh(nh);
+    sensorNh.setCallbackQueue(&sensorQueue);
+    ros::NodeHandle controlNh(nh);
+    controlNh.setCallbackQueue(&controlQueue);
+
     goalId = 1;
+    executeWaiting = 0;
+    configPending = false;
+    followingPath = false;
+    pathIndex = 0;
     stop = false;
     gravityConstant = 9.81;
 
     dynamic_reconfigure::Server<move_smooth::MovesmoothConfig>::CallbackType f;
     f = boost::bind(&MoveBasic::dynamicReconfigCallback, this, _1, _2);
-    dr_srv.setCallback(f);
+    dr_srv.reset(new dynamic_reconfigure::Server<move_smooth::MovesmoothConfig>(controlNh));
+    dr_srv->setCallback(f);
+    applyConfig();
 
     cmdPub = ros::Publisher(nh.advertise<geometry_msgs::Twist>("/cmd_vel", 1));
     pathPub = ros::Publisher(nh.advertise<nav_msgs::Path>("/plan", 1));
@@ -235,23 +418,139 @@ MoveBasic::MoveBasic(): tfBuffer(ros::Duration(3.0)),
     obstacle_dist_pub =
         ros::Publisher(nh.advertise<geometry_msgs::Vector3>("/obstacle_distance", 1));
 
-    goalSub = nh.subscribe("/move_base_simple/goal", 1,
-                            &MoveBasic::goalCallback, this);
+    // Loop timings, the cycles overrun if they take longer than their period
+    double diagnosticsRate;
+    nh.param<double>("diagnostics_rate", diagnosticsRate, 1.0);
+    diagnosticsPeriod = ros::WallDuration(1.0 / std::max(diagnosticsRate, 0.01));
+    diagnosticsPub = ros::Publisher(nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1));
+    stats[LoopStats::follow_cycle].set_budget(ros::WallDuration(1.0 / 50));
+    stats[LoopStats::rotate_cycle].set_budget(ros::WallDuration(1.0 / 50));
+    stats[LoopStats::run_cycle].set_budget(ros::WallDuration(1.0 / 20));
+    stats[LoopStats::wake_lateness].set_budget(ros::WallDuration(1.0 / 50));
+    // A stop should reach cmd_vel within a millisecond
+    stats[LoopStats::stop_latency].set_budget(ros::WallDuration(0.001));
+
+    statsServer = controlNh.advertiseService("dump_stats", &MoveBasic::statsService, this);
+
+    // The last flight_recorder_size commands and the state they were
+    // computed from, written to flight_recorder_file when a goal aborts
+    // or on SIGUSR1
+    int flightRecords;
+    nh.param<int>("flight_recorder_size", flightRecords, 4096);
+    nh.param<std::string>("flight_recorder_file", flightFile, "/tmp/move_smooth_flight.bin");
+    flight_recorder.reset(new FlightRecorder(std::max(flightRecords, 1)));
+    flightState = FlightRecord();
+    flightGoal = 0;
+    FlightRecorder::dump_on_signal(SIGUSR1);
+
+    // Chrome trace of the callbacks and control cycles, written to
+    // trace_file on exit or by the write_trace service.  Started before
+    // any of the threads so they all get named.
+    nh.param<std::string>("trace_file", traceFile, "");
+    int traceEvents;
+    nh.param<int>("trace_events", traceEvents, 100000);
+    if (!traceFile.empty()) {
+        trace::start(std::max(traceEvents, 1));
+        trace::set_thread_name("main");
+        traceServer = controlNh.advertiseService("write_trace", &MoveBasic::traceService, this);
+        ROS_INFO("MoveSmooth: Tracing to %s", traceFile.c_str());
+    }
+
+    goalSub = controlNh.subscribe("/move_base_simple/goal", 1,
+                                  &MoveBasic::goalCallback, this);
+    pathSub = controlNh.subscribe("/move_smooth/path", 1,
+                                  &MoveBasic::pathCallback, this);
     ros::NodeHandle actionNh("");
+    actionNh.setCallbackQueue(&controlQueue);
 
     actionServer.reset(new MoveBaseActionServer(actionNh, "move_base",
 	        boost::bind(&MoveBasic::executeAction, this, _1)));
+    actionServer->setMaxQueueLength(goalQueueLength);
 
     actionServer->start();
     goalPub = actionNh.advertise<move_base_msgs::MoveBaseActionGoal>(
       "/move_base/goal", 1);
 
-    obstacle_points.reset(new ObstaclePoints(nh, tfBuffer));
+    // Whole paths, followed without stopping at each pose
+    pathServer.reset(new FollowPathActionServer(actionNh, "follow_path",
+            boost::bind(&MoveBasic::executePath, this, _1), false));
+    pathServer->start();
+    pathGoalPub = actionNh.advertise<move_smooth::FollowPathActionGoal>(
+      "/follow_path/goal", 1);
+
+    // Robot poses come from TF, or straight from odometry with use_odometry.
+    // In event driven mode odometry also triggers the control loops.
+    pose_provider.reset(new PoseProvider(sensorNh, tfBuffer,
+                                         eventDriven ? &updateTrigger : nullptr, clock));
+    pose_provider->set_goal_cache_size(goalLookahead + 2);
+    baseFrame = pose_provider->get_base_frame();
+    preferredDrivingFrame = PoseProvider::resolve(preferredDrivingFrame);
+    alternateDrivingFrame = PoseProvider::resolve(alternateDrivingFrame);
+
+    obstacle_points.reset(new ObstaclePoints(sensorNh, tfBuffer, clock));
     collision_checker.reset(new CollisionChecker(nh, tfBuffer, *obstacle_points));
+    collision_checker->min_side_dist = minSideDist;
+
+    // Clearance is computed on its own thread as obstacle data arrives,
+    // and the control loops are woken up when it changes
+    double clearanceRate;
+    nh.param<double>("clearance_rate", clearanceRate, 20.0);
+    clearance_worker.reset(new ClearanceWorker(*collision_checker, std::max(clearanceRate, 1.0)));
+    obstacle_points->set_update_trigger(&clearance_worker->obstacle_trigger());
+    clearance_worker->set_update_trigger(&updateTrigger);
+    clearance_worker->set_query_histogram(&stats[LoopStats::clearance_query]);
+    clearance_worker->start();
+
+    ros::NodeHandle serviceNh;
+    serviceNh.setCallbackQueue(&serviceQueue);
+    stopServer = serviceNh.advertiseService("stop_move", &MoveBasic::stopService, this);
+
+    sensorSpinner.reset(new ros::AsyncSpinner(std::max(sensorThreads, 1), &sensorQueue));
+    controlSpinner.reset(new ros::AsyncSpinner(std::max(controlThreads, 1), &controlQueue));
+    sensorSpinner->start();
+    controlSpinner->start();
+    servicesRunning = true;
+    serviceThread = std::thread(&MoveBasic::serviceLoop, this);
 
     ROS_INFO("Move Smooth ready");
 }
 
+MoveBasic::~MoveBasic()
+{
+    servicesRunning = false;
+    if (serviceThread.joinable()) {
+        serviceThread.join();
+    }
+    // The worker notifies updateTrigger and records into stats, which
+    // are destroyed before it
+    if (clearance_worker) {
+        clearance_worker->stop();
+    }
+    if (trace::enabled() && !trace::write(traceFile)) {
+        ROS_ERROR("MoveSmooth: Cannot write trace to %s", traceFile.c_str());
+    }
+}
+
+// Serve the service queue
+
+void MoveBasic::serviceLoop()
+{
+    trace::set_thread_name("service");
+    if (stopThreadPriority > 0) {
+        sched_param param;
+        param.sched_priority = stopThreadPriority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err) {
+            ROS_WARN("MoveSmooth: Cannot raise the priority of the stop thread: %s",
+                     strerror(err));
+        }
+    }
+
+    while (servicesRunning && ros::ok()) {
+        serviceQueue.callAvailable(ros::WallDuration(0.1));
+    }
+}
+
 // Limit velocities
 
 double MoveBasic::limitLinearVelocity(const double& velocity)
@@ -269,40 +568,51 @@ double MoveBasic::limitAngularVelocity(const double& velocity)
 bool MoveBasic::getTransform(const std::string& from, const std::string& to,
                              tf2::Transform& tf)
 {
-    try {
-        geometry_msgs::TransformStamped tfs =
-            tfBuffer.lookupTransform(to, from, ros::Time(0));
-        tf2::fromMsg(tfs.transform, tf);
-        return true;
-    }
-    catch (tf2::TransformException &ex) {
-         return false;
-    }
+    StageTimer timer(stats[LoopStats::tf_lookup]);
+    return pose_provider->get_transform(from, to, tf);
 }
 
 
-// Transform a pose from one frame to another, returns true on success
+// Transform a goal pose from one frame to another, returns true on success.
+// The result is cached, so repeated calls for the same goal are cheap.
 
 bool MoveBasic::transformPose(const std::string& from, const std::string& to,
                               const tf2::Transform& in, tf2::Transform& out)
 {
-    tf2::Transform tf;
-    if (!getTransform(from, to, tf))
-        return false;
-
-    out = tf * in;
-    return true;
+    return pose_provider->transform_goal(from, in, to, out);
 }
 
 // Dynamic reconfigure
 
 void MoveBasic::dynamicReconfigCallback(move_smooth::MovesmoothConfig& config, uint32_t){
+    trace::Scope scope("reconfigure");
+    {
+        const std::lock_guard<std::mutex> lock(configMutex);
+        pendingConfig = config;
+        configPending = true;
+    }
+    ROS_WARN("MoveSmooth: Parameter change detected");
+}
+
+// Take up the latest config, only called by the thread executing goals
+// or before they start
+
+void MoveBasic::applyConfig()
+{
+    if (!configPending) {
+        return;
+    }
+    const std::lock_guard<std::mutex> lock(configMutex);
+    configPending = false;
+    const move_smooth::MovesmoothConfig& config = pendingConfig;
     maxAngularVelocity = config.max_angular_velocity;
     minAngularVelocity = config.min_angular_velocity;
     maxAngularAcceleration = config.max_angular_acceleration;
     maxLinearVelocity = config.max_linear_velocity;
     minLinearVelocity = config.min_linear_velocity;
     maxLinearAcceleration = config.max_linear_acceleration;
+    maxLinearJerk = config.max_linear_jerk;
+    maxAngularJerk = config.max_angular_jerk;
     maxIncline = config.max_incline_without_slipping;
     angleTolerance = config.angular_tolerance;
     linearTolerance = config.linear_tolerance;
@@ -313,8 +623,9 @@ void MoveBasic::dynamicReconfigCallback(move_smooth::MovesmoothConfig& config, u
     maxLateralDev = config.max_lateral_dev;
     runawayTimeoutSecs = config.runaway_timeout;
     forwardObstacleThreshold = config.forward_obstacle_threshold;
-
-    ROS_WARN("MoveSmooth: Parameter change detected");
+    if (collision_checker) {
+        collision_checker->min_side_dist = minSideDist;
+    }
 }
 
 // Stop robot in place and save last state
@@ -322,30 +633,213 @@ void MoveBasic::dynamicReconfigCallback(move_smooth::MovesmoothConfig& config, u
 bool MoveBasic::stopService(move_smooth::Stop::Request &req,
                      move_smooth::Stop::Response &)
 {
-    stop = req.stop;
-    if (stop) ROS_WARN("MoveSmooth: Robot is forced to stop!");
+    trace::Scope scope("stop service");
+    ros::WallTime received = ros::WallTime::now();
+    {
+        const std::lock_guard<std::mutex> lock(cmdMutex);
+        stop = req.stop;
+        if (stop) {
+            cmdPub.publish(stopMsg);
+        }
+    }
+
+    if (req.stop) {
+        ros::WallDuration latency = ros::WallTime::now() - received;
+        stats[LoopStats::stop_latency].record(latency.toNSec());
+        ROS_WARN("MoveSmooth: Robot is forced to stop! Zero command sent after %.3f ms",
+                 latency.toSec() * 1000.0);
+    }
+    else {
+        ROS_INFO("MoveSmooth: Stop released");
+    }
 
     return true;
 }
 
+// Dump the loop timings
+
+bool MoveBasic::statsService(std_srvs::Trigger::Request &,
+                             std_srvs::Trigger::Response &res)
+{
+    res.message = stats.dump();
+    res.success = true;
+    return true;
+}
+
+// Write the trace recorded so far
+
+bool MoveBasic::traceService(std_srvs::Trigger::Request &,
+                             std_srvs::Trigger::Response &res)
+{
+    res.success = trace::write(traceFile);
+    res.message = res.success ? traceFile : "Cannot write " + traceFile;
+    return true;
+}
+
 // Called when a simple goal message is received
 
 void MoveBasic::goalCallback(const geometry_msgs::PoseStamped::ConstPtr &msg)
 {
+    trace::Scope scope("goal callback");
     move_base_msgs::MoveBaseActionGoal actionGoal;
-    actionGoal.header.stamp = ros::Time::now();
-    actionGoal.goal_id.id = std::to_string(goalId);
-    goalId = goalId + 1;
+    actionGoal.header.stamp = clock.now();
+    actionGoal.goal_id.id = std::to_string(goalId++);
     actionGoal.goal.target_pose = *msg;
     goalPub.publish(actionGoal);
 }
 
+// Called when a simple path message is received
+
+void MoveBasic::pathCallback(const nav_msgs::Path::ConstPtr &msg)
+{
+    trace::Scope scope("path callback");
+    move_smooth::FollowPathActionGoal actionGoal;
+    actionGoal.header.stamp = clock.now();
+    actionGoal.goal_id.id = std::to_string(goalId++);
+    actionGoal.goal.path = *msg;
+    pathGoalPub.publish(actionGoal);
+}
+
+// Wait for the next control step. In event driven mode this is as soon
+// as new data has arrived since seen, or after the watchdog period,
+// otherwise it is the next tick of r.
+
+void MoveBasic::waitForUpdate(ClockRate& r, uint64_t& seen)
+{
+    applyConfig();
+
+    ros::Duration period;
+    if (!eventDriven) {
+        r.sleep();
+        period = r.expected_cycle_time();
+    }
+    else {
+        // The watchdog is on wall time, as a guard against sensors that
+        // have gone quiet
+        updateTrigger.wait(seen, watchdogPeriod);
+        seen = updateTrigger.count();
+        period = ros::Duration(watchdogPeriod.toSec());
+    }
+
+    // How much later than its period the loop woke up, lastWake is
+    // cleared when a loop starts
+    ros::Time now = clock.now();
+    if (!lastWake.isZero()) {
+        ros::Duration late = (now - lastWake) - period;
+        stats[LoopStats::wake_lateness].record(late.toNSec() > 0 ? late.toNSec() : 0);
+    }
+    lastWake = now;
+}
+
+// Latest clearance from the perception thread
+
+std::shared_ptr<const Clearance> MoveBasic::getClearance()
+{
+    StageTimer timer(stats[LoopStats::obstacle_fetch]);
+    return clearance_worker->get_clearance();
+}
+
 // Abort goal and print message
 
 void MoveBasic::abortGoal(const std::string msg)
 {
-    actionServer->setAborted(move_base_msgs::MoveBaseResult(), msg);
+    if (followingPath) {
+        move_smooth::FollowPathResult result;
+        result.waypoints_reached = pathIndex;
+        pathServer->setAborted(result, msg);
+    }
+    else {
+        actionServer->setAborted(move_base_msgs::MoveBaseResult(), msg);
+    }
     ROS_ERROR("MoveSmooth: %s", msg.c_str());
+    dumpFlightRecord(msg);
+}
+
+// Note the state the next command is computed from
+
+void MoveBasic::setFlightState(uint8_t mode, const tf2::Transform& poseDriving,
+                               double distance, double angle, const Clearance& clearance)
+{
+    double x, y, yaw;
+    getPose(poseDriving.inverse(), x, y, yaw);
+    flightState.mode = mode;
+    flightState.x = x;
+    flightState.y = y;
+    flightState.yaw = yaw;
+    flightState.distance = distance;
+    flightState.angle = angle;
+    flightState.forward = clearance.forward;
+    flightState.rear = clearance.rear;
+    flightState.left = clearance.left;
+    flightState.right = clearance.right;
+    flightState.rotate_left = clearance.rotate_left;
+    flightState.rotate_right = clearance.rotate_right;
+    flightState.clearance_age = (clock.now() - clearance.stamp).toSec();
+}
+
+// Write out the flight recorder, for scripts/flight_decode.py
+
+void MoveBasic::dumpFlightRecord(const std::string& reason)
+{
+    if (flight_recorder->dump(flightFile, flightGoal, clock.now().toSec(), reason)) {
+        ROS_WARN("MoveSmooth: Flight record of goal %u written to %s",
+                 (unsigned) flightGoal, flightFile.c_str());
+    }
+    else {
+        ROS_ERROR("MoveSmooth: Cannot write flight record to %s: %s",
+                  flightFile.c_str(), strerror(errno));
+    }
+}
+
+// Whether there is a goal to drive on to after the current one
+
+bool MoveBasic::isNextGoalAvailable()
+{
+    if (followingPath) {
+        return pathIndex + 1 < pathInDriving.size();
+    }
+    return actionServer->isNewGoalAvailable();
+}
+
+bool MoveBasic::isPreemptRequested()
+{
+    // A goal for the other server is waiting for this one to finish
+    if (executeWaiting > 0) {
+        return true;
+    }
+    if (followingPath) {
+        return pathServer->isPreemptRequested();
+    }
+    return actionServer->isPreemptRequested();
+}
+
+void MoveBasic::setPreempted()
+{
+    if (followingPath) {
+        move_smooth::FollowPathResult result;
+        result.waypoints_reached = pathIndex;
+        pathServer->setPreempted(result);
+    }
+    else {
+        actionServer->setPreempted();
+    }
+}
+
+// Choose the frame to drive in, the preferred one if the robot pose is
+// available in it, returns true on success
+
+bool MoveBasic::getDrivingFrame(std::string& drivingFrame, tf2::Transform& currentDrivingBase)
+{
+    if (!getTransform(preferredDrivingFrame, baseFrame, currentDrivingBase)) {
+         ROS_WARN("MoveSmooth: %s not available, attempting to drive using %s frame",
+                  preferredDrivingFrame.c_str(), alternateDrivingFrame.c_str());
+         if (!getTransform(alternateDrivingFrame, baseFrame, currentDrivingBase)) {
+             return false;
+         }
+         else drivingFrame = alternateDrivingFrame;
+    }
+    else drivingFrame = preferredDrivingFrame;
+    return true;
 }
 
 
@@ -353,6 +847,16 @@ void MoveBasic::abortGoal(const std::string msg)
 
 void MoveBasic::executeAction(const move_base_msgs::MoveBaseGoalConstPtr& msg)
 {
+    executeWaiting++;
+    const std::lock_guard<std::mutex> lock(executeMutex);
+    executeWaiting--;
+    applyConfig();
+    // The transforms between the frames have moved on since the last goal
+    pose_provider->clear_goals();
+    followingPath = false;
+    flightState = FlightRecord();
+    flightState.goal = ++flightGoal;
+
     /*
       It is assumed that we are dealing with imperfect localization data:
          map->base_link is accurate but may be delayed and is at a slow rate
@@ -379,17 +883,10 @@ void MoveBasic::executeAction(const move_base_msgs::MoveBaseGoalConstPtr& msg)
     std::string drivingFrame;
     tf2::Transform goalInDriving;
     tf2::Transform currentDrivingBase;
-    if (!getTransform(preferredDrivingFrame, baseFrame, currentDrivingBase)) {
-         ROS_WARN("MoveSmooth: %s not available, attempting to drive using %s frame",
-                  preferredDrivingFrame.c_str(), alternateDrivingFrame.c_str());
-         if (!getTransform(alternateDrivingFrame, baseFrame, currentDrivingBase)) {
-             abortGoal("MoveSmooth: Cannot determine robot pose in driving frame");
-             return;
-         }
-         else drivingFrame = alternateDrivingFrame;
+    if (!getDrivingFrame(drivingFrame, currentDrivingBase)) {
+         abortGoal("MoveSmooth: Cannot determine robot pose in driving frame");
+         return;
     }
-    else drivingFrame = preferredDrivingFrame;
-
 
     // Publish our planned path
     nav_msgs::Path path;
@@ -446,7 +943,7 @@ void MoveBasic::executeAction(const move_base_msgs::MoveBaseGoalConstPtr& msg)
     }
 
     // Rotate towards final orientation if new goal not available
-    if (!actionServer->isNewGoalAvailable()) {
+    if (!isNextGoalAvailable()) {
         if (!rotate(goalYaw, drivingFrame)) {
             return;
         }
@@ -455,16 +952,136 @@ void MoveBasic::executeAction(const move_base_msgs::MoveBaseGoalConstPtr& msg)
     actionServer->setSucceeded();
 }
 
+// Called when a path is received on the follow_path action
+
+void MoveBasic::executePath(const move_smooth::FollowPathGoalConstPtr& msg)
+{
+    // The follow_path server runs this on its own thread
+    trace::set_thread_name("path execute");
+    trace::Scope scope("follow path");
+    executeWaiting++;
+    const std::lock_guard<std::mutex> lock(executeMutex);
+    executeWaiting--;
+    applyConfig();
+    // The transforms between the frames have moved on since the last goal
+    pose_provider->clear_goals();
+    followingPath = true;
+    flightState = FlightRecord();
+    flightState.goal = ++flightGoal;
+    pathIndex = 0;
+    pathInDriving.clear();
+
+    const nav_msgs::Path& path = msg->path;
+    ROS_INFO("MoveSmooth: Received path of %zu poses in %s", path.poses.size(),
+             path.header.frame_id.c_str());
+    if (path.poses.empty()) {
+        abortGoal("MoveSmooth: Aborting path because it has no poses");
+        return;
+    }
+
+    std::string drivingFrame;
+    tf2::Transform currentDrivingBase;
+    if (!getDrivingFrame(drivingFrame, currentDrivingBase)) {
+         abortGoal("MoveSmooth: Cannot determine robot pose in driving frame");
+         return;
+    }
+
+    // Transform the whole path into the driving frame, with one lookup
+    // for each run of poses in the same frame
+    std::string frameId;
+    tf2::Transform frameInDriving;
+    bool haveTransform = false;
+    pathInDriving.reserve(path.poses.size());
+    for (const auto& pose : path.poses) {
+        std::string poseFrame = PoseProvider::resolve(pose.header.frame_id.empty() ?
+                                                      path.header.frame_id : pose.header.frame_id);
+        if (!haveTransform || poseFrame != frameId) {
+            if (!getTransform(poseFrame, drivingFrame, frameInDriving)) {
+                abortGoal("MoveSmooth: Cannot determine path pose in driving frame");
+                return;
+            }
+            frameId = poseFrame;
+            haveTransform = true;
+        }
+
+        tf2::Transform goal;
+        tf2::fromMsg(pose.pose, goal);
+        double x, y, yaw;
+        getPose(goal, x, y, yaw);
+        if (std::isnan(yaw)) {
+            abortGoal("MoveSmooth: Aborting path because an invalid orientation was specified");
+            return;
+        }
+        pathInDriving.push_back(frameInDriving * goal);
+    }
+
+    pathPub.publish(path);
+
+    // Drive through each pose in turn, only stopping at the last one
+    move_smooth::FollowPathFeedback feedback;
+    feedback.total_waypoints = pathInDriving.size();
+    for (pathIndex = 0; pathIndex < pathInDriving.size(); pathIndex++) {
+        feedback.waypoint = pathIndex;
+        feedback.target_pose = path.poses[pathIndex];
+        pathServer->publishFeedback(feedback);
+
+        tf2::Transform poseDriving;
+        if (!getTransform(drivingFrame, baseFrame, poseDriving)) {
+             abortGoal("MoveSmooth: Cannot determine robot pose for driving");
+             return;
+        }
+        tf2::Vector3 remaining = (poseDriving * pathInDriving[pathIndex]).getOrigin();
+        if (std::sqrt(remaining.x() * remaining.x() + remaining.y() * remaining.y()) <= linearTolerance) {
+            // already close enough to this pose
+            continue;
+        }
+
+        if (!smoothFollow(drivingFrame, pathInDriving[pathIndex]))
+            return;
+    }
+
+    // Rotate towards final orientation
+    double x, y, goalYaw;
+    getPose(pathInDriving.back(), x, y, goalYaw);
+    if (!rotate(goalYaw, drivingFrame)) {
+        return;
+    }
+
+    move_smooth::FollowPathResult result;
+    result.waypoints_reached = pathInDriving.size();
+    pathServer->setSucceeded(result);
+}
+
 // Send a motion command
 
 void MoveBasic::sendCmd(double angular, double linear)
 {
-   if (stop) { angular = 0; linear = 0; }
-   geometry_msgs::Twist msg;
-   msg.angular.z = angular;
-   msg.linear.x = linear;
-
-   cmdPub.publish(msg);
+   bool stopped;
+   {
+       // Only the publish is ordered against a stop, so that a command
+       // on its way out holds up the stop service as little as possible
+       const std::lock_guard<std::mutex> lock(cmdMutex);
+       stopped = stop;
+       if (stopped) { angular = 0; linear = 0; }
+       cmdMsg.angular.z = angular;
+       cmdMsg.linear.x = linear;
+
+       alloc_counter::Ignore ignore;
+       StageTimer timer(stats[LoopStats::command_publish]);
+       cmdPub.publish(cmdMsg);
+   }
+
+   // the arc clearance is checked for the last command
+   clearance_worker->set_velocity(linear, angular);
+
+   flightState.stamp = clock.now().toSec();
+   flightState.linear = linear;
+   flightState.angular = angular;
+   flightState.flags = stopped ? (flightState.flags | FlightRecord::stopped) :
+                                 (flightState.flags & ~FlightRecord::stopped);
+   flight_recorder->record(flightState);
+
+   latency.record(updateTrigger.stamp());
 }
 
 
@@ -472,22 +1089,32 @@ void MoveBasic::sendCmd(double angular, double linear)
 
 void MoveBasic::run()
 {
-    ros::Rate r(20);
-
+    ClockRate r(clock, 20);
+    ros::WallTime lastDiagnostics = ros::WallTime::now();
 
     while (ros::ok()) {
-        ros::spinOnce();
-        collision_checker->min_side_dist = minSideDist;
-        forwardObstacleDist = collision_checker->obstacle_dist(true,
-                                                               leftObstacleDist,
-                                                               rightObstacleDist,
-                                                               forwardLeft,
-                                                               forwardRight);
-        geometry_msgs::Vector3 msg;
-        msg.x = forwardObstacleDist;
-        msg.y = leftObstacleDist;
-        msg.z = rightObstacleDist;
-        obstacle_dist_pub.publish(msg);
+        {
+            AllocationCheck::Scope check(runCheck);
+            StageTimer cycleTimer(stats[LoopStats::run_cycle]);
+            trace::Scope scope("run cycle");
+            std::shared_ptr<const Clearance> clearance = getClearance();
+            obstacleDistMsg.x = clearance->forward;
+            obstacleDistMsg.y = clearance->left;
+            obstacleDistMsg.z = clearance->right;
+            alloc_counter::Ignore ignore;
+            obstacle_dist_pub.publish(obstacleDistMsg);
+        }
+
+        ros::WallTime now = ros::WallTime::now();
+        if (now - lastDiagnostics > diagnosticsPeriod) {
+            alloc_counter::Ignore ignore;
+            stats.publish(diagnosticsPub, clock.now());
+            lastDiagnostics = now;
+        }
+
+        if (FlightRecorder::signal_pending()) {
+            dumpFlightRecord("Requested by signal");
+        }
 
         r.sleep();
     }
@@ -502,15 +1129,30 @@ bool MoveBasic::rotate(double& finalOrientation,
     double previousAngleRemaining = 0.0;
     int oscillations = 0;
 
+    // The first cycles look up and cache the goal
+    rotateCheck.restart();
+
+    // Velocity profile, planned from the current speed
+    angularProfile.reset();
+    ros::Time profileStart;
+
     bool done = false;
-    ros::Rate r(50);
+    ClockRate r(clock, 50);
+    uint64_t seen = updateTrigger.count();
+    lastWake = ros::Time();
 
     while(!done && ros::ok()){
-        ros::spinOnce();
-        r.sleep();
+        waitForUpdate(r, seen);
+
+        // While the stop is latched sendCmd holds the robot still, the
+        // loop carries on so that preempts and new goals are handled
+        AllocationCheck::Scope check(rotateCheck);
+        StageTimer cycleTimer(stats[LoopStats::rotate_cycle]);
+        trace::Scope scope("rotate cycle");
 
         tf2::Transform poseDriving;
         if (!getTransform(drivingFrame, baseFrame, poseDriving)) {
+             alloc_counter::Ignore ignore;
              abortGoal("MoveSmooth: Cannot determine robot pose for driving");
              return false;
         }
@@ -520,8 +1162,10 @@ bool MoveBasic::rotate(double& finalOrientation,
         double angleRemaining = finalOrientation - (-currentYawInDriving);
         normalizeAngle(angleRemaining);
 
-        double obstacle = collision_checker->obstacle_angle(angleRemaining > 0);
+        std::shared_ptr<const Clearance> clearance = getClearance();
+        double obstacle = (angleRemaining > 0) ? clearance->rotate_left : clearance->rotate_right;
         double obstacleAngle = std::min(std::abs(angleRemaining), std::abs(obstacle));
+        setFlightState(FlightRecord::rotating, poseDriving, 0.0, angleRemaining, *clearance);
 
         if (sign(previousAngleRemaining) != sign(angleRemaining))
             oscillations++;
@@ -529,23 +1173,43 @@ bool MoveBasic::rotate(double& finalOrientation,
 
         if (std::abs(angleRemaining) < angleTolerance || oscillations > 2) {
             sendCmd(0, 0);
+            alloc_counter::Ignore ignore;
             ROS_INFO("MoveSmooth: ORIENTATION ERROR ~ yaw: %f degrees", rad2deg(angleRemaining));
             ROS_INFO("MoveSmooth: Goal reached");
             return true;
         }
 
-        double angularVelocity = limitAngularVelocity(std::max(minAngularVelocity,
-                                            std::sqrt(2.0 * maxAngularAcceleration * obstacleAngle)));
+        double angularVelocity;
+        if (maxAngularJerk > 0.0) {
+            // Replan only when the robot has strayed from the profile, or
+            // an obstacle is closer than it allows
+            ros::Time now = clock.now();
+            double t = (now - profileStart).toSec();
+            if (!angularProfile.valid() ||
+                std::abs(angularProfile.remaining_at(t) - obstacleAngle) > profileReplanAngle) {
+                angularProfile.plan(obstacleAngle, std::abs(cmdMsg.angular.z), 0.0,
+                                    maxAngularVelocity, maxAngularAcceleration, maxAngularJerk);
+                profileStart = now;
+                t = 0.0;
+            }
+            angularVelocity = limitAngularVelocity(std::max(minAngularVelocity,
+                                                            angularProfile.velocity_at(t)));
+        }
+        else {
+            angularVelocity = limitAngularVelocity(std::max(minAngularVelocity,
+                                                std::sqrt(2.0 * maxAngularAcceleration * obstacleAngle)));
+        }
 
-        if (actionServer->isNewGoalAvailable()) {
+        if (isNextGoalAvailable()) {
             angularVelocity = 0;
             done = true;
         }
 
-        if (actionServer->isPreemptRequested()) {
+        if (isPreemptRequested()) {
+            alloc_counter::Ignore ignore;
             ROS_INFO("MoveSmooth: Stopping rotation due to preempt");
             sendCmd(0, 0);
-            actionServer->setPreempted();
+            setPreempted();
             return false;
         }
 
@@ -578,9 +1242,7 @@ bool MoveBasic::smoothFollow(const std::string& drivingFrame,
     double requestedDistance = linear.length();
 
     // Abort check
-    ros::Time last = ros::Time::now();
-    ros::Duration runawayTimeout(runawayTimeoutSecs);
-    double prevDistanceRemaining = requestedDistance;
+    runaway.start(requestedDistance, ros::Duration(runawayTimeoutSecs));
 
     // Lateral control
     double angleRemaining = 0.0;
@@ -589,15 +1251,38 @@ bool MoveBasic::smoothFollow(const std::string& drivingFrame,
     double prevLateralError = 0.0;
     double lateralDiff = 0.0;
 
+    double linearVelocity = 0.0;
+    double angularVelocity = 0.0;
+
+    // Velocity profile, planned from the current speed
+    linearProfile.reset();
+    ros::Time profileStart;
+    double profileEndVelocity = 0.0;
+
+    // The first cycles look up and cache the goals and plan the profile
+    followCheck.restart();
+
     bool done = false;
-    ros::Rate r(50);
+    ClockRate r(clock, 50);
+    uint64_t seen = updateTrigger.count();
+    lastWake = ros::Time();
 
     while(!done && ros::ok()){
-        ros::spinOnce();
-        r.sleep();
+        waitForUpdate(r, seen);
+
+        // While the stop is latched sendCmd holds the robot still, the
+        // loop carries on so that preempts and new goals are handled.
+        // Holding still doesn't count as a runaway.
+        if (stop) {
+            runaway.hold();
+        }
+        AllocationCheck::Scope check(followCheck);
+        StageTimer cycleTimer(stats[LoopStats::follow_cycle]);
+        trace::Scope scope("follow cycle");
 
         tf2::Transform poseDriving;
         if (!getTransform(drivingFrame, baseFrame, poseDriving)) {
+             alloc_counter::Ignore ignore;
              abortGoal("MoveSmooth: Cannot determine robot pose for driving");
              return false;
         }
@@ -609,55 +1294,49 @@ bool MoveBasic::smoothFollow(const std::string& drivingFrame,
         angleRemaining = std::atan2(remaining.y(), remaining.x());
         normalizeAngle(angleRemaining);
 
-        // Collision avoidance
-        double obstacle = collision_checker->obstacle_angle(angleRemaining > 0);
+        // Collision avoidance, from the latest clearance of the perception thread
+        std::shared_ptr<const Clearance> clearance = getClearance();
+        double obstacle = (angleRemaining > 0) ? clearance->rotate_left : clearance->rotate_right;
         double obstacleAngle = std::min(std::abs(angleRemaining), std::abs(obstacle));
-        double obstacleDist = forwardObstacleDist;
+        double obstacleDist = clearance->forward;
         if (distRemaining < 0.0) { // Reverse
-            obstacleDist = collision_checker->obstacle_dist(false,
-                                                    leftObstacleDist,
-                                                    rightObstacleDist,
-                                                    forwardLeft,
-                                                    forwardRight);
+            obstacleDist = clearance->rear;
         }
         ROS_DEBUG("MoveSmooth: %f L %f, R %f\n",
-                forwardObstacleDist, leftObstacleDist, rightObstacleDist);
+                obstacleDist, clearance->left, clearance->right);
 
         bool obstacleDetected = (obstacleDist <= forwardObstacleThreshold);
+        setFlightState(FlightRecord::following, poseDriving, distRemaining, angleRemaining, *clearance);
+        flightState.flags = obstacleDetected ? (flightState.flags | FlightRecord::obstacle) :
+                                               (flightState.flags & ~FlightRecord::obstacle);
         if (obstacleDetected) { // Stop if there is an obstacle in the distance we would hit in given time
             sendCmd(0, 0);
-            ROS_INFO("MoveSmooth: Waiting for OBSTACLE");
+            alloc_counter::Ignore ignore;
+            ROS_INFO_THROTTLE(1.0, "MoveSmooth: Waiting for OBSTACLE");
             continue;
         }
 
         // Preempt check
-        if (actionServer->isPreemptRequested()) {
+        if (isPreemptRequested()) {
+            alloc_counter::Ignore ignore;
             ROS_INFO("MoveSmooth: Stopping due to preempt request");
-            actionServer->setPreempted();
+            setPreempted();
             done = false;
             goto FinishWithStop;
         }
 
-        /* Since we are dealing with imperfect localization we should make
-         * sure we are at least runawayTimeout driving away from the goal*/
-        double localizationDev = 0.02;
-        if (std::cos(angleRemaining) < 0 and (prevDistanceRemaining + localizationDev) < distRemaining) {
-            if (ros::Time::now() - last > runawayTimeout) {
-                abortGoal("MoveSmooth: Moving away from goal");
-                sendCmd(0, 0);
-                return false;
-            }
-        }
-        else {
-            // Only update time when moving towards the goal
-            last = ros::Time::now();
+        if (runaway.update(distRemaining, angleRemaining)) {
+            alloc_counter::Ignore ignore;
+            abortGoal("MoveSmooth: Moving away from goal");
+            sendCmd(0, 0);
+            return false;
         }
-        prevDistanceRemaining = distRemaining;
 
         /* Finish Check */
 
         if (distRemaining < linearTolerance) {
-            if (actionServer->isNewGoalAvailable()) { // If next goal available keep up with velocity
+            alloc_counter::Ignore ignore;
+            if (isNextGoalAvailable()) { // If next goal available keep up with velocity
                 ROS_INFO("MoveSmooth: Intermitent goal reached - ERROR: x: %f meters, y: %f meters",
                         remaining.x(), remaining.y());
                 done = true;
@@ -669,12 +1348,59 @@ bool MoveBasic::smoothFollow(const std::string& drivingFrame,
             goto FinishWithStop;
         }
 
+        // Next goal state
+        bool nextGoalAvailable = isNextGoalAvailable();
+        double maxTurnVelocity = 0.0;
+        double distanceToNextGoal = 0.0;
+        if (nextGoalAvailable && !queuedGoalVelocity(drivingFrame, poseDriving, goalInDriving,
+                                                     maxTurnVelocity, distanceToNextGoal)) {
+             alloc_counter::Ignore ignore;
+             abortGoal("MoveSmooth: Cannot determine next goal pose in driving frame");
+             done = false;
+             goto FinishWithStop;
+        }
+
         // Linear control
-        double linearAccelerationConstraint = std::sqrt(2.0 * maxLinearAcceleration *
-                                                              std::min(obstacleDist, distRemaining));
-        double proportionalControl = distRemaining;
-        double linearVelocity = limitLinearVelocity(std::max(minLinearVelocity,
-                    std::min(proportionalControl, linearAccelerationConstraint)));
+        if (maxLinearJerk > 0.0) {
+            // Plan to pass through the goal, or to stop at it or at an obstacle
+            double endVelocity = 0.0;
+            if (nextGoalAvailable) {
+                endVelocity = std::min(distanceToNextGoal, maxTurnVelocity);
+            }
+            double target = distRemaining;
+            if (obstacleDist < distRemaining) {
+                target = std::max(obstacleDist, 0.0);
+                endVelocity = 0.0;
+            }
+
+            // Replan only when the robot has strayed from the profile, or
+            // the obstacles or goals have changed
+            ros::Time now = clock.now();
+            double t = (now - profileStart).toSec();
+            if (!linearProfile.valid() ||
+                std::abs(linearProfile.remaining_at(t) - target) > profileReplanDistance ||
+                std::abs(profileEndVelocity - endVelocity) > profileReplanVelocity) {
+                linearProfile.plan(target, std::abs(cmdMsg.linear.x), endVelocity,
+                                   maxLinearVelocity, maxLinearAcceleration, maxLinearJerk);
+                profileStart = now;
+                profileEndVelocity = endVelocity;
+                t = 0.0;
+            }
+            linearVelocity = limitLinearVelocity(std::max(minLinearVelocity,
+                                                          linearProfile.velocity_at(t)));
+        }
+        else {
+            double linearAccelerationConstraint = std::sqrt(2.0 * maxLinearAcceleration *
+                                                                  std::min(obstacleDist, distRemaining));
+            double proportionalControl = distRemaining;
+            linearVelocity = limitLinearVelocity(std::max(minLinearVelocity,
+                        std::min(proportionalControl, linearAccelerationConstraint)));
+
+            if (nextGoalAvailable) {
+                double nextGoalVelocity = distanceToNextGoal;
+                linearVelocity = limitLinearVelocity(std::min(nextGoalVelocity, std::max(linearVelocity, maxTurnVelocity)));
+            }
+        }
 
         // Lateral control
         lateralError = remaining.y();
@@ -683,37 +1409,7 @@ bool MoveBasic::smoothFollow(const std::string& drivingFrame,
         lateralIntegral += lateralError;
         double pidAngularVelocity = (lateralKp * lateralError) + (lateralKi * lateralIntegral) + (lateralKd * lateralDiff);
         double angularAccelerationConstraint = std::sqrt(2.0 * maxAngularAcceleration * obstacleAngle);
-        double angularVelocity = limitAngularVelocity(std::min(pidAngularVelocity, angularAccelerationConstraint));
-
-        // Next goal state
-        if (actionServer->isNewGoalAvailable()) {
-            move_base_msgs::MoveBaseActionGoal nextGoal;
-            nextGoal.goal = *(actionServer->getQueuedGoalState());
-            std::string frameIdNext = nextGoal.goal.target_pose.header.frame_id;
-            ROS_DEBUG_STREAM(nextGoal);
-
-            // Next goal in driving frame
-            tf2::Transform nextGoalInDriving;
-            tf2::Transform nextGoalPose;
-            tf2::fromMsg(nextGoal.goal.target_pose.pose, nextGoalPose);
-            if (!transformPose(frameIdNext, drivingFrame, nextGoalPose, nextGoalInDriving)) {
-                 abortGoal("MoveSmooth: Cannot determine next goal pose in driving frame");
-                 done = false;
-                 goto FinishWithStop;
-            }
-
-            // Next goal in base frame
-            tf2::Transform nextGoalInBase = poseDriving * nextGoalInDriving;
-            tf2::Vector3 nextRemaining = nextGoalInBase.getOrigin();
-            double distanceToNextGoal = sqrt(nextRemaining.x() * nextRemaining.x() + nextRemaining.y() * nextRemaining.y());
-            double angleToNextGoal = std::atan2(nextRemaining.y(), nextRemaining.x());
-            normalizeAngle(angleToNextGoal);
-
-            // Turn algorithm - calculating the maximum allowed speed when cornering in order for the robot not to slip or tip over
-            double maxTurnVelocity = sqrt(gravityConstant * maxIncline * maxLateralDev / (1 - cos(angleToNextGoal/2)));
-            double nextGoalVelocity = distanceToNextGoal;
-            linearVelocity = limitLinearVelocity(std::min(nextGoalVelocity, std::max(linearVelocity, maxTurnVelocity)));
-        }
+        angularVelocity = limitAngularVelocity(std::min(pidAngularVelocity, angularAccelerationConstraint));
 
         sendCmd(angularVelocity, linearVelocity);
     }
@@ -725,13 +1421,98 @@ bool MoveBasic::smoothFollow(const std::string& drivingFrame,
     return done;
 }
 
+// Turn algorithm - calculating the maximum allowed speed when cornering in order for the robot not to slip or tip over
+
+double MoveBasic::cornerVelocity(double angle)
+{
+    return sqrt(gravityConstant * maxIncline * maxLateralDev / (1 - cos(angle/2)));
+}
+
+// Speed at which to pass through the current goal on to the queued goals,
+// or the rest of the path. Up to goalLookahead goals are looked at: the
+// speed through each corner is limited, it has to leave room to slow down
+// for the corners after it, and to stop at the last goal if the path ends
+// there, or the queue when goals are queued.
+
+bool MoveBasic::queuedGoalVelocity(const std::string& drivingFrame,
+                                   const tf2::Transform& poseDriving,
+                                   const tf2::Transform& goalInDriving,
+                                   double& velocity, double& distanceToNextGoal)
+{
+    lookaheadPoints.clear();
+    lookaheadPoints.push_back(goalInDriving.getOrigin());
+    bool lastGoal;
+    if (followingPath) {
+        // The rest of the path is already in the driving frame
+        size_t end = std::min(pathInDriving.size(), pathIndex + 1 + goalLookahead);
+        for (size_t i = pathIndex + 1; i < end; i++) {
+            lookaheadPoints.push_back(pathInDriving[i].getOrigin());
+        }
+        lastGoal = end == pathInDriving.size();
+    }
+    else {
+        for (int i = 0; i < goalLookahead; i++) {
+            // Refer to the queued goal rather than copying it
+            move_base_msgs::MoveBaseGoalConstPtr nextGoal = actionServer->getQueuedGoal(i);
+            if (!nextGoal) {
+                break;
+            }
+            ROS_DEBUG_STREAM(*nextGoal);
+
+            tf2::Transform nextGoalPose;
+            tf2::Transform nextGoalInDriving;
+            tf2::fromMsg(nextGoal->target_pose.pose, nextGoalPose);
+            if (!transformPose(nextGoal->target_pose.header.frame_id, drivingFrame,
+                               nextGoalPose, nextGoalInDriving)) {
+                return false;
+            }
+            lookaheadPoints.push_back(nextGoalInDriving.getOrigin());
+        }
+        // With a single queued goal the next goal may not be the last
+        // one sent, so pass through it as before queueing
+        lastGoal = goalQueueLength > 1 &&
+                   actionServer->getQueueLength() <= lookaheadPoints.size() - 1;
+    }
+
+    if (lookaheadPoints.size() < 2) {
+        // the queued goal has been canceled since it was checked for
+        velocity = 0.0;
+        distanceToNextGoal = std::numeric_limits<double>::infinity();
+        return true;
+    }
+
+    // Next goal in base frame
+    tf2::Vector3 nextRemaining = poseDriving * lookaheadPoints[1];
+    distanceToNextGoal = sqrt(nextRemaining.x() * nextRemaining.x() + nextRemaining.y() * nextRemaining.y());
+
+    // Work back from the furthest goal looked at
+    size_t last = lookaheadPoints.size() - 1;
+    velocity = lastGoal ? 0.0 : maxLinearVelocity;
+    for (size_t i = last; i-- > 0;) {
+        tf2::Vector3 leg = lookaheadPoints[i + 1] - lookaheadPoints[i];
+        leg.setZ(0);
+        double angle;
+        if (i == 0) {
+            // the robot is turning from its current heading
+            angle = std::atan2(nextRemaining.y(), nextRemaining.x());
+        }
+        else {
+            tf2::Vector3 prevLeg = lookaheadPoints[i] - lookaheadPoints[i - 1];
+            angle = std::atan2(prevLeg.x() * leg.y() - prevLeg.y() * leg.x(),
+                               prevLeg.x() * leg.x() + prevLeg.y() * leg.y());
+        }
+        normalizeAngle(angle);
+
+        velocity = std::min(cornerVelocity(angle),
+                            std::sqrt(velocity * velocity + 2.0 * maxLinearAcceleration * leg.length()));
+    }
+    return true;
+}
 
 int main(int argc, char ** argv) {
     ros::init(argc, argv, "move_basic");
     MoveBasic mb_node;
 
-    ros::NodeHandle nh;
-    ros::ServiceServer stop_service = nh.advertiseService("stop_move", &MoveBasic::stopService, (MoveBasic*) &mb_node);
     mb_node.run();
 
     return 0;
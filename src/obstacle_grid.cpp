@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include "move_smooth/obstacle_grid.h"
+
+#include <algorithm>
+
+ObstacleGrid::ObstacleGrid() : cell_size(0.1), extent(10.0), cells(200)
+{
+    cell_start.assign(cells * cells + 1, 0);
+}
+
+void ObstacleGrid::configure(float cell_size, float extent)
+{
+    this->cell_size = cell_size;
+    this->cells = (int) std::ceil(2 * extent / cell_size);
+    // keep the grid centred on base_link
+    this->extent = cells * cell_size / 2;
+    cell_start.assign(cells * cells + 1, 0);
+    points.clear();
+    overflow.clear();
+}
+
+void ObstacleGrid::build(const ObstacleCloud& cloud)
+{
+    const size_t n = cloud.size();
+
+    // Counting sort by cell: count, prefix sum, scatter
+    std::fill(cell_start.begin(), cell_start.end(), 0);
+    point_cell.resize(n);
+    overflow.clear();
+    for (size_t i = 0; i < n; i++) {
+        int ix = cell_of(cloud.x[i]);
+        int iy = cell_of(cloud.y[i]);
+        if (ix < 0 || ix >= cells || iy < 0 || iy >= cells) {
+            point_cell[i] = -1;
+            overflow.push_back(cloud.x[i], cloud.y[i]);
+            continue;
+        }
+        point_cell[i] = ix * cells + iy;
+        cell_start[point_cell[i] + 1]++;
+    }
+    for (size_t c = 1; c < cell_start.size(); c++) {
+        cell_start[c] += cell_start[c - 1];
+    }
+
+    const size_t count = cell_start.back();
+    points.x.resize(count);
+    points.y.resize(count);
+    // cell_start[c] is used as the insert position of cell c and
+    // ends up as the start of cell c + 1
+    for (size_t i = 0; i < n; i++) {
+        int c = point_cell[i];
+        if (c < 0) {
+            continue;
+        }
+        uint32_t pos = cell_start[c]++;
+        points.x[pos] = cloud.x[i];
+        points.y[pos] = cloud.y[i];
+    }
+    // shift back so that cell_start[c] is the start of cell c
+    for (size_t c = cell_start.size() - 1; c > 0; c--) {
+        cell_start[c] = cell_start[c - 1];
+    }
+    cell_start[0] = 0;
+}
@@ -30,18 +30,51 @@
  */
 
 #include "move_smooth/obstacle_points.h"
+#include "move_smooth/trace.h"
 #include <sensor_msgs/Range.h>
 
-ObstaclePoints::ObstaclePoints(ros::NodeHandle& nh, tf2_ros::Buffer& tf_buffer) : tf_buffer(tf_buffer) {
+#include <atomic>
+
+// True if only the caller holds p, so that the object can be rewritten.
+// use_count() is a relaxed load, so the acquire fence is needed to order
+// the rewrite after everything the last reader did before it dropped its
+// reference.
+template <class T>
+static bool unshared(const std::shared_ptr<T>& p)
+{
+    if (!p || p.use_count() != 1) {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+
+ObstaclePoints::ObstaclePoints(ros::NodeHandle& nh, tf2_ros::Buffer& tf_buffer,
+                               const Clock& clock) : snapshot_version(0),
+                                                     tf_buffer(tf_buffer),
+                                                     clock(clock),
+                                                     have_lidar(false),
+                                                     lidar_current(0),
+                                                     trigger(nullptr) {
     sonar_sub = nh.subscribe("/sonars", 1,
         &ObstaclePoints::range_callback, this);
     scan_sub = nh.subscribe("/scan", 1,
         &ObstaclePoints::scan_callback, this);
     
     nh.param<std::string>("base_frame", baseFrame, "base_link");
+
+    polar_ring_width = nh.param<float>("polar_ring_width", 0.005);
+    polar_max_radius = nh.param<float>("polar_max_radius", 2.0);
+    polar_bearing_bins = nh.param<int>("polar_bearing_bins", 720);
+    grid_cell_size = nh.param<float>("grid_cell_size", 0.1);
+    grid_extent = nh.param<float>("grid_extent", 10.0);
+
+    std::atomic_store(&snapshot, std::shared_ptr<const ObstacleSnapshot>(
+                                     std::make_shared<ObstacleSnapshot>()));
 }
 
 void ObstaclePoints::range_callback(const sensor_msgs::Range::ConstPtr &msg) {
+    trace::Scope scope("range callback");
     std::string frame = msg->header.frame_id;
     ROS_DEBUG("Callback %s %f", frame.c_str(), msg->range);
 
@@ -96,22 +129,23 @@ void ObstaclePoints::range_callback(const sensor_msgs::Range::ConstPtr &msg) {
         }
         catch (tf2::TransformException &ex) {
             ROS_WARN("%s", ex.what());
+            return;
         }
     }
     else {
         RangeSensor& sensor = it->second;
         sensor.update(msg->range, msg->header.stamp);
     }
+
+    publish_snapshot(msg->header.stamp);
 }
 
 void ObstaclePoints::scan_callback(const sensor_msgs::LaserScan::ConstPtr &msg)
 {
-    float theta = msg->angle_min;
-    float increment = msg->angle_increment;
+    trace::Scope scope("scan callback");
     float range_min = msg->range_min;
     
     const std::lock_guard<std::mutex> lock(points_mutex);
-    lidar_stamp = msg->header.stamp;
 
     if (!have_lidar) {
         try {
@@ -146,80 +180,168 @@ void ObstaclePoints::scan_callback(const sensor_msgs::LaserScan::ConstPtr &msg)
         }
     }
 
+    if (!lidar_table.matches(*msg)) {
+        ROS_INFO("Building scan table for %s, %zu beams",
+                 msg->header.frame_id.c_str(), msg->ranges.size());
+        lidar_table.build(*msg, lidar_normal);
+    }
+
+    const float ox = lidar_origin.x();
+    const float oy = lidar_origin.y();
+    const std::vector<float>& dir_x = lidar_table.dir_x;
+    const std::vector<float>& dir_y = lidar_table.dir_y;
+
+    // Reuse the spare buffer unless a reader still holds on to it
+    release_idle_snapshots();
+    int next = 1 - lidar_current;
+    std::shared_ptr<ObstacleCloud>& buffer = lidar_buffers[next];
+    if (!unshared(buffer)) {
+        buffer = std::make_shared<ObstacleCloud>();
+    }
+    ObstacleCloud& lidar_points = *buffer;
+
     lidar_points.clear();
-    for (const auto& r : msg->ranges) {
-        theta += increment;
+    lidar_points.reserve(msg->ranges.size());
+    for (size_t i = 0; i < msg->ranges.size(); i++) {
+        float r = msg->ranges[i];
 
         // ignore bogus samples
         if (std::isnan(r) || r < range_min) {
             continue;
         }
 
-        lidar_points.push_back(PolarLine(r, theta));
+        lidar_points.push_back(ox + r * dir_x[i], oy + r * dir_y[i]);
     }
-}
-  
-std::vector<tf2::Vector3> ObstaclePoints::get_points(ros::Duration max_age) {
-    ros::Time now = ros::Time::now();
-    std::vector<tf2::Vector3> points;
 
-    const std::lock_guard<std::mutex> lock(points_mutex);
-    ros::Duration lidar_age = now - lidar_stamp;
-    if (lidar_age < max_age) {
-	for (const auto& p : lidar_points) {
-	    float sin_theta = std::sin(p.theta);
-	    float cos_theta = std::cos(p.theta);
+    // Index for the rotation and arc queries, built here so that the
+    // queries don't pay for the binning...
+    std::shared_ptr<PolarIndex>& index = lidar_index_buffers[next];
+    if (!unshared(index)) {
+        index = std::make_shared<PolarIndex>();
+        index->configure(polar_ring_width, polar_max_radius, polar_bearing_bins);
+    }
+    index->build(lidar_points);
+
+    // and the grid for the distance queries
+    std::shared_ptr<ObstacleGrid>& grid = lidar_grid_buffers[next];
+    if (!unshared(grid)) {
+        grid = std::make_shared<ObstacleGrid>();
+        grid->configure(grid_cell_size, grid_extent);
+    }
+    grid->build(lidar_points);
 
-	    float x = lidar_origin.x() + p.radius * (lidar_normal.x() * cos_theta -
-		 lidar_normal.y() * sin_theta);
+    lidar_current = next;
+    lidar_stamp = msg->header.stamp;
 
-	    float y = lidar_origin.y() + p.radius * (lidar_normal.y() * cos_theta +
-		 lidar_normal.x() * sin_theta);
+    publish_snapshot(lidar_stamp);
+}
 
-	    points.push_back(tf2::Vector3(x, y, 0));
-	}
+void ObstaclePoints::publish_snapshot(const ros::Time& stamp)
+{
+    std::shared_ptr<ObstacleSnapshot> next;
+    for (auto& pooled : snapshot_pool) {
+        if (!pooled) {
+            pooled = std::make_shared<ObstacleSnapshot>();
+        }
+        if (unshared(pooled)) {
+            next = pooled;
+            break;
+        }
+    }
+    if (!next) {
+        // all in use, readers are holding on to old snapshots
+        next = std::make_shared<ObstacleSnapshot>();
     }
 
+    next->version = ++snapshot_version;
+    next->stamp = stamp;
+
+    next->lidar_stamp = lidar_stamp;
+    next->lidar_points = lidar_buffers[lidar_current];
+    next->lidar_index = lidar_index_buffers[lidar_current];
+    next->lidar_grid = lidar_grid_buffers[lidar_current];
+
+    next->range_points.clear();
+    next->range_stamps.clear();
+    next->range_points.reserve(2 * sensors.size());
+    next->range_stamps.reserve(sensors.size());
     for (const auto& kv : sensors) {
         const RangeSensor& sensor = kv.second;
+        next->range_points.push_back(sensor.left_vertex.x(), sensor.left_vertex.y());
+        next->range_points.push_back(sensor.right_vertex.x(), sensor.right_vertex.y());
+        next->range_stamps.push_back(sensor.stamp);
+    }
+
+    next->test_points = test_points;
+    next->test_stamp = test_stamp;
+
+    std::atomic_store(&snapshot, std::shared_ptr<const ObstacleSnapshot>(next));
+
+    if (trigger) {
+        trigger->notify(stamp);
+    }
+}
 
-	ros::Duration age = now - sensor.stamp;
-        if (age < max_age) {
-           points.push_back(sensor.left_vertex);
-           points.push_back(sensor.right_vertex);
+void ObstaclePoints::set_update_trigger(UpdateTrigger* trigger)
+{
+    this->trigger = trigger;
+}
+
+void ObstaclePoints::release_idle_snapshots()
+{
+    for (auto& pooled : snapshot_pool) {
+        if (unshared(pooled)) {
+            pooled->lidar_points.reset();
+            pooled->lidar_index.reset();
+            pooled->lidar_grid.reset();
+            pooled->test_points.reset();
         }
     }
+}
+
+std::shared_ptr<const ObstacleSnapshot> ObstaclePoints::get_snapshot() const
+{
+    return std::atomic_load(&snapshot);
+}
+  
+std::vector<tf2::Vector3> ObstaclePoints::get_points(ros::Duration max_age) {
+    ros::Time now = clock.now();
+    std::vector<tf2::Vector3> points;
 
-    // Add all the test points
-    points.insert(points.end(), test_points.begin(), test_points.end());
+    get_snapshot()->for_each_point(now, max_age, [&points](float x, float y) {
+        points.push_back(tf2::Vector3(x, y, 0));
+    });
 
     return points;
 }
 
 std::vector<ObstaclePoints::Line> ObstaclePoints::get_lines(ros::Duration max_age) {
-    ros::Time now = ros::Time::now();
+    ros::Time now = clock.now();
     
-    const std::lock_guard<std::mutex> lock(points_mutex);
     std::vector<ObstaclePoints::Line> lines;
-    for (const auto& kv : sensors) {
-        const RangeSensor& sensor = kv.second;
-	ros::Duration age = now - sensor.stamp;
-	if (age < max_age) {
-	    lines.emplace_back(sensor.left_vertex, sensor.right_vertex);
-	}
-    }
+    get_snapshot()->for_each_line(now, max_age,
+        [&lines](float x0, float y0, float x1, float y1) {
+            lines.emplace_back(tf2::Vector3(x0, y0, 0), tf2::Vector3(x1, y1, 0));
+        });
 
     return lines;
 }
 
 void ObstaclePoints::add_test_point(tf2::Vector3 p) {
     const std::lock_guard<std::mutex> lock(points_mutex);
-    test_points.push_back(p);
+    // published clouds are immutable, so copy on write
+    std::shared_ptr<ObstacleCloud> points = test_points ?
+        std::make_shared<ObstacleCloud>(*test_points) : std::make_shared<ObstacleCloud>();
+    points->push_back(p.x(), p.y());
+    test_points = points;
+    test_stamp = clock.now();
+    publish_snapshot(test_stamp);
 }
 
 void ObstaclePoints::clear_test_points() {
     const std::lock_guard<std::mutex> lock(points_mutex);
-    test_points.clear();
+    test_points.reset();
+    publish_snapshot(clock.now());
 }
 
 RangeSensor::RangeSensor(int id, std::string frame_id,
@@ -242,9 +364,33 @@ void RangeSensor::update(float range, ros::Time stamp)
     right_vertex = origin + right_vec * range;
 }
 
-ObstaclePoints::PolarLine::PolarLine(float radius, float theta)
+ObstaclePoints::ScanTable::ScanTable() : angle_min(0), angle_increment(0), count(0)
+{
+}
+
+bool ObstaclePoints::ScanTable::matches(const sensor_msgs::LaserScan& scan) const
 {
-    this->radius = radius;
-    this->theta = theta;
+    return count == scan.ranges.size() &&
+           angle_min == scan.angle_min &&
+           angle_increment == scan.angle_increment;
 }
 
+void ObstaclePoints::ScanTable::build(const sensor_msgs::LaserScan& scan,
+                                      const tf2::Vector3& normal)
+{
+    angle_min = scan.angle_min;
+    angle_increment = scan.angle_increment;
+    count = scan.ranges.size();
+
+    dir_x.resize(count);
+    dir_y.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        double theta = angle_min + i * angle_increment;
+        double sin_theta = std::sin(theta);
+        double cos_theta = std::cos(theta);
+
+        // rotate the beam direction by the lidar normal
+        dir_x[i] = normal.x() * cos_theta - normal.y() * sin_theta;
+        dir_y[i] = normal.y() * cos_theta + normal.x() * sin_theta;
+    }
+}
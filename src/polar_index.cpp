@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include "move_smooth/polar_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+PolarIndex::PolarIndex() : ring_width(0.005), rings(400), bearing_bins(720)
+{
+    ring_start.assign(rings + 2, 0);
+}
+
+void PolarIndex::configure(float ring_width, float max_radius, size_t bearing_bins)
+{
+    this->ring_width = ring_width;
+    this->rings = (size_t) std::ceil(max_radius / ring_width);
+    this->bearing_bins = bearing_bins;
+    ring_start.assign(rings + 2, 0);
+    points.clear();
+}
+
+void PolarIndex::build(const ObstacleCloud& cloud)
+{
+    const size_t overflow = rings * bearing_bins;
+    const float bins_per_radian = bearing_bins / (2.0 * M_PI);
+
+    entries.clear();
+    entries.reserve(cloud.size());
+    for (size_t i = 0; i < cloud.size(); i++) {
+        const float x = cloud.x[i];
+        const float y = cloud.y[i];
+        Entry e;
+        e.radius = std::sqrt(x*x + y*y);
+        const size_t ring = ring_of(e.radius);
+        e.bearing = std::atan2(y, x);
+        e.x = x;
+        e.y = y;
+        if (ring < rings) {
+            size_t bin = (size_t) ((e.bearing + M_PI) * bins_per_radian);
+            e.bin = ring * bearing_bins + std::min(bin, bearing_bins - 1);
+        }
+        else {
+            e.bin = overflow;
+        }
+        entries.push_back(e);
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.bin < b.bin || (a.bin == b.bin && a.bearing < b.bearing);
+    });
+
+    points.clear();
+    points.reserve(entries.size());
+    size_t ring = 0;
+    ring_start[0] = 0;
+    for (size_t i = 0; i < entries.size(); ) {
+        // find the end of this bin
+        size_t j = i + 1;
+        while (j < entries.size() && entries[j].bin == entries[i].bin) {
+            j++;
+        }
+
+        const size_t bin_ring = entries[i].bin / bearing_bins;
+        while (ring < bin_ring) {
+            ring_start[++ring] = points.size();
+        }
+
+        if (entries[i].bin == overflow) {
+            for (size_t k = i; k < j; k++) {
+                points.push_back(entries[k].x, entries[k].y);
+            }
+        }
+        else {
+            // smallest and largest bearing in the bin, and the closest
+            // point if that is neither, so that a bin that reaches into
+            // a query's range is never dropped
+            size_t closest = i;
+            for (size_t k = i + 1; k < j; k++) {
+                if (entries[k].radius < entries[closest].radius) {
+                    closest = k;
+                }
+            }
+            points.push_back(entries[i].x, entries[i].y);
+            if (closest != i && closest != j - 1) {
+                points.push_back(entries[closest].x, entries[closest].y);
+            }
+            if (j - i > 1) {
+                points.push_back(entries[j - 1].x, entries[j - 1].y);
+            }
+        }
+        i = j;
+    }
+    while (ring <= rings) {
+        ring_start[++ring] = points.size();
+    }
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include "move_smooth/pose_provider.h"
+#include "move_smooth/trace.h"
+
+#include <tf2_geometry_msgs/tf2_geometry_msgs.h>
+
+#include <algorithm>
+
+PoseProvider::PoseProvider(ros::NodeHandle& nh, tf2_ros::Buffer& tf_buffer,
+                           UpdateTrigger* trigger,
+                           const Clock& clock) : tf_buffer(tf_buffer),
+                                                 clock(clock),
+                                                 trigger(trigger),
+                                                 next_goal(0)
+{
+    nh.param<std::string>("base_frame", base_frame, "base_link");
+    nh.param<std::string>("odom_frame", odom_frame, "odom");
+    base_frame = resolve(base_frame);
+    odom_frame = resolve(odom_frame);
+
+    // Read the pose in odom_frame from the odometry messages
+    nh.param<bool>("use_odometry", use_odometry, false);
+    double timeout;
+    nh.param<double>("odom_timeout", timeout, 0.1);
+    odom_timeout = ros::Duration(timeout);
+
+    // Combine the latest map->odom correction with the latest pose in
+    // odom, rather than waiting for both to be available at one time.
+    // Without use_odometry that takes two lookups instead of one, so
+    // it is off by default.
+    nh.param<bool>("fuse_odometry", fuse_odometry, use_odometry);
+
+    std::string odom_topic;
+    nh.param<std::string>("odom_topic", odom_topic, "/odom");
+    if (use_odometry || trigger) {
+        // The event driven loops step on odometry, so it shouldn't wait
+        // for more data to fill a segment
+        odom_sub = nh.subscribe(odom_topic, 1, &PoseProvider::odom_callback, this,
+                                ros::TransportHints().tcpNoDelay());
+    }
+
+    set_goal_cache_size(4);
+}
+
+void PoseProvider::set_goal_cache_size(size_t size)
+{
+    goals.assign(std::max<size_t>(size, 1), CachedGoal());
+    clear_goals();
+}
+
+void PoseProvider::clear_goals()
+{
+    for (auto& cached : goals) {
+        cached.valid = false;
+    }
+    next_goal = 0;
+}
+
+std::string PoseProvider::resolve(const std::string& frame)
+{
+    if (!frame.empty() && frame[0] == '/') {
+        return frame.substr(1);
+    }
+    return frame;
+}
+
+void PoseProvider::odom_callback(const nav_msgs::Odometry::ConstPtr& msg)
+{
+    trace::Scope scope("odom callback");
+    if (use_odometry && resolve(msg->header.frame_id) == odom_frame &&
+        resolve(msg->child_frame_id) == base_frame) {
+        OdomPose value;
+        value.stamp = msg->header.stamp;
+        tf2::fromMsg(msg->pose.pose, value.pose);
+        odom.write(value);
+    }
+
+    if (trigger) {
+        trigger->notify(msg->header.stamp);
+    }
+}
+
+bool PoseProvider::lookup(const std::string& from, const std::string& to,
+                          tf2::Transform& tf)
+{
+    try {
+        geometry_msgs::TransformStamped tfs =
+            tf_buffer.lookupTransform(to, from, ros::Time(0));
+        tf2::fromMsg(tfs.transform, tf);
+        return true;
+    }
+    catch (tf2::TransformException &ex) {
+         return false;
+    }
+}
+
+bool PoseProvider::base_in_odom(tf2::Transform& pose)
+{
+    if (use_odometry) {
+        OdomPose value;
+        if (odom.read(value) && clock.now() - value.stamp <= odom_timeout) {
+            pose = value.pose;
+            return true;
+        }
+    }
+    return lookup(base_frame, odom_frame, pose);
+}
+
+bool PoseProvider::get_transform(const std::string& from, const std::string& to,
+                                 tf2::Transform& tf)
+{
+    tf2::Transform pose;
+    if (from == base_frame && to == odom_frame) {
+        return base_in_odom(tf);
+    }
+    if (from == odom_frame && to == base_frame) {
+        if (!base_in_odom(pose)) {
+            return false;
+        }
+        tf = pose.inverse();
+        return true;
+    }
+
+    // Chain the latest correction from a slow frame such as map into
+    // odom with the latest robot pose in odom.  A direct lookup would
+    // give the pose at the time of the last correction instead.
+    if (fuse_odometry && (from == base_frame || to == base_frame) &&
+        from != to) {
+        const std::string& frame = from == base_frame ? to : from;
+        tf2::Transform correction;     // frame in odom_frame
+        if (lookup(frame, odom_frame, correction) && base_in_odom(pose)) {
+            if (from == base_frame) {
+                tf = correction.inverseTimes(pose);
+            }
+            else {
+                tf = pose.inverseTimes(correction);
+            }
+            return true;
+        }
+    }
+
+    return lookup(from, to, tf);
+}
+
+bool PoseProvider::transform_goal(const std::string& goal_frame, const tf2::Transform& goal,
+                                  const std::string& frame, tf2::Transform& out)
+{
+    for (const auto& cached : goals) {
+        if (cached.valid && cached.goal == goal &&
+            cached.goal_frame == goal_frame && cached.frame == frame) {
+            out = cached.in_frame;
+            return true;
+        }
+    }
+
+    tf2::Transform tf;
+    if (!get_transform(resolve(goal_frame), frame, tf)) {
+        return false;
+    }
+    out = tf * goal;
+
+    // replace the oldest entry
+    CachedGoal& cached = goals[next_goal];
+    next_goal = (next_goal + 1) % goals.size();
+    cached.valid = true;
+    cached.goal_frame = goal_frame;
+    cached.goal = goal;
+    cached.frame = frame;
+    cached.in_frame = out;
+    return true;
+}
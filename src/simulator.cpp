@@ -0,0 +1,531 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include "move_smooth/simulator.h"
+
+#include <geometry_msgs/TransformStamped.h>
+#include <nav_msgs/Odometry.h>
+#include <rosgraph_msgs/Clock.h>
+#include <sensor_msgs/Range.h>
+#include <std_srvs/Trigger.h>
+#include <tf2/LinearMath/Quaternion.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+static double cross(double ax, double ay, double bx, double by)
+{
+    return ax * by - ay * bx;
+}
+
+// Distance from p to the segment ab
+
+static double segment_distance(const Point& p, const Point& a, const Point& b)
+{
+    double ex = b.x - a.x, ey = b.y - a.y;
+    double length2 = ex * ex + ey * ey;
+    double t = 0.0;
+    if (length2 > 0.0) {
+        t = std::max(0.0, std::min(1.0, ((p.x - a.x) * ex + (p.y - a.y) * ey) / length2));
+    }
+    return std::hypot(p.x - (a.x + t * ex), p.y - (a.y + t * ey));
+}
+
+static bool inside(const Point& p, const Polygon& polygon)
+{
+    bool in = false;
+    for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+        const Point& a = polygon[i];
+        const Point& b = polygon[j];
+        if ((a.y > p.y) != (b.y > p.y) &&
+            p.x < a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y)) {
+            in = !in;
+        }
+    }
+    return in;
+}
+
+static double number(const XmlRpc::XmlRpcValue& value)
+{
+    if (value.getType() == XmlRpc::XmlRpcValue::TypeInt) {
+        return static_cast<int>(value);
+    }
+    return static_cast<double>(value);
+}
+
+// Reads a list of [x, y, ...] lists, each with at least size numbers
+
+static bool read_lists(const XmlRpc::XmlRpcValue& value, int size,
+                       std::vector<std::vector<double>>& out)
+{
+    if (value.getType() != XmlRpc::XmlRpcValue::TypeArray) {
+        return false;
+    }
+    for (int i = 0; i < value.size(); i++) {
+        const XmlRpc::XmlRpcValue& item = value[i];
+        if (item.getType() != XmlRpc::XmlRpcValue::TypeArray || item.size() < size) {
+            return false;
+        }
+        std::vector<double> numbers;
+        for (int j = 0; j < item.size(); j++) {
+            numbers.push_back(number(item[j]));
+        }
+        out.push_back(numbers);
+    }
+    return true;
+}
+
+
+Simulator::Simulator() : nh("~"), cmd_count(0), cmd_linear(0.0), cmd_angular(0.0)
+{
+    nh.param<std::string>("map_frame", map_frame, "map");
+    nh.param<std::string>("odom_frame", odom_frame, "odom");
+    nh.param<std::string>("base_frame", base_frame, "base_link");
+    nh.param<std::string>("laser_frame", laser_frame, "laser");
+
+    nh.param<double>("step", step, 0.02);
+    double sensor_period;
+    nh.param<double>("sensor_period", sensor_period, 0.1);
+    sensor_steps = std::max(1, static_cast<int>(std::round(sensor_period / step)));
+    nh.param<double>("command_timeout", command_timeout, 0.05);
+    nh.param<double>("goal_timeout", goal_timeout, 120.0);
+    // 0 to run as fast as possible
+    nh.param<double>("realtime_factor", realtime_factor, 0.0);
+    nh.param<double>("robot_radius", robot_radius, 0.2);
+    nh.param<double>("min_clearance", min_clearance, 0.0);
+
+    nh.param<double>("laser_x", laser_x, 0.0);
+    nh.param<int>("scan_beams", scan_beams, 360);
+    nh.param<double>("scan_range", scan_range, 8.0);
+    nh.param<double>("sonar_fov", sonar_fov, 0.5);
+    nh.param<double>("sonar_range", sonar_range, 2.0);
+
+    clock_pub = ros::Publisher(nh.advertise<rosgraph_msgs::Clock>("/clock", 1));
+    odom_pub = ros::Publisher(nh.advertise<nav_msgs::Odometry>("/odom", 10));
+    scan_pub = ros::Publisher(nh.advertise<sensor_msgs::LaserScan>("/scan", 1));
+    sonar_pub = ros::Publisher(nh.advertise<sensor_msgs::Range>("/sonars", 10));
+    // Every step waits for the command, so don't let Nagle hold it back
+    cmd_sub = nh.subscribe("/cmd_vel", 10, &Simulator::cmd_callback, this,
+                           ros::TransportHints().tcpNoDelay());
+
+    scan.header.frame_id = laser_frame;
+    scan.angle_min = -M_PI;
+    scan.angle_increment = 2.0 * M_PI / std::max(scan_beams, 1);
+    scan.angle_max = scan.angle_min + (std::max(scan_beams, 1) - 1) * scan.angle_increment;
+    scan.range_min = 0.05;
+    scan.range_max = scan_range;
+    scan.ranges.resize(std::max(scan_beams, 1));
+
+    // Start the clock away from 0, which means unset
+    now = ros::Time(1.0);
+    linear = 0.0;
+    angular = 0.0;
+}
+
+// Read the world, sensors, start pose and goals, returns false if they
+// are malformed
+
+bool Simulator::load()
+{
+    XmlRpc::XmlRpcValue value;
+    std::vector<std::vector<double>> lists;
+
+    if (nh.getParam("obstacles", value)) {
+        if (value.getType() != XmlRpc::XmlRpcValue::TypeArray) {
+            ROS_ERROR("MoveSmoothSim: obstacles must be a list of polygons");
+            return false;
+        }
+        for (int i = 0; i < value.size(); i++) {
+            lists.clear();
+            if (!read_lists(value[i], 2, lists) || lists.size() < 2) {
+                ROS_ERROR("MoveSmoothSim: obstacle %d must be a list of [x, y] points", i);
+                return false;
+            }
+            Polygon polygon;
+            for (const auto& p : lists) {
+                polygon.push_back(Point{p[0], p[1]});
+            }
+            world.push_back(polygon);
+        }
+    }
+
+    lists.clear();
+    if (nh.getParam("sonars", value)) {
+        if (!read_lists(value, 3, lists)) {
+            ROS_ERROR("MoveSmoothSim: sonars must be a list of [x, y, yaw] in the base frame");
+            return false;
+        }
+        for (const auto& s : lists) {
+            sonars.push_back(Sonar{Point{s[0], s[1]}, s[2]});
+        }
+    }
+
+    lists.clear();
+    if (!nh.getParam("goals", value) || !read_lists(value, 3, lists) || lists.empty()) {
+        ROS_ERROR("MoveSmoothSim: goals must be a list of [x, y, yaw] in the map frame");
+        return false;
+    }
+    for (const auto& g : lists) {
+        goals.push_back(Goal{Point{g[0], g[1]}, g[2]});
+    }
+
+    std::vector<double> start;
+    nh.param<std::vector<double>>("start", start, std::vector<double>{0.0, 0.0, 0.0});
+    if (start.size() != 3) {
+        ROS_ERROR("MoveSmoothSim: start must be [x, y, yaw] in the map frame");
+        return false;
+    }
+    position = Point{start[0], start[1]};
+    yaw = start[2];
+    return true;
+}
+
+void Simulator::cmd_callback(const geometry_msgs::Twist::ConstPtr& msg)
+{
+    {
+        const std::lock_guard<std::mutex> lock(cmd_mutex);
+        cmd_linear = msg->linear.x;
+        cmd_angular = msg->angular.z;
+        cmd_count++;
+    }
+    cmd_condition.notify_one();
+}
+
+// The latest command, for tests that drive move_smooth themselves
+
+uint64_t Simulator::get_command(double& linear, double& angular)
+{
+    const std::lock_guard<std::mutex> lock(cmd_mutex);
+    linear = cmd_linear;
+    angular = cmd_angular;
+    return cmd_count;
+}
+
+// Wait for a command after seen, returns false on timeout
+
+bool Simulator::wait_for_command(uint64_t seen)
+{
+    std::unique_lock<std::mutex> lock(cmd_mutex);
+    return cmd_condition.wait_for(lock, std::chrono::duration<double>(command_timeout),
+                                  [&] { return cmd_count > seen; });
+}
+
+// Unicycle model, the command is applied as is
+
+void Simulator::advance(double dt)
+{
+    {
+        const std::lock_guard<std::mutex> lock(cmd_mutex);
+        linear = cmd_linear;
+        angular = cmd_angular;
+    }
+    if (std::abs(angular) > 1e-9) {
+        double yaw_end = yaw + angular * dt;
+        double r = linear / angular;
+        position.x += r * (std::sin(yaw_end) - std::sin(yaw));
+        position.y -= r * (std::cos(yaw_end) - std::cos(yaw));
+        yaw = std::remainder(yaw_end, 2.0 * M_PI);
+    }
+    else {
+        position.x += linear * dt * std::cos(yaw);
+        position.y += linear * dt * std::sin(yaw);
+    }
+    now += ros::Duration(dt);
+}
+
+// Distance along a ray to the closest polygon edge, max_range if none
+
+double Simulator::cast(const Point& origin, double angle, double max_range) const
+{
+    double dx = std::cos(angle), dy = std::sin(angle);
+    double closest = max_range;
+    for (const Polygon& polygon : world) {
+        for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+            const Point& a = polygon[j];
+            double ex = polygon[i].x - a.x, ey = polygon[i].y - a.y;
+            double denominator = cross(dx, dy, ex, ey);
+            if (std::abs(denominator) < 1e-12) {
+                continue;
+            }
+            double t = cross(a.x - origin.x, a.y - origin.y, ex, ey) / denominator;
+            double s = cross(a.x - origin.x, a.y - origin.y, dx, dy) / denominator;
+            if (t >= 0.0 && s >= 0.0 && s <= 1.0) {
+                closest = std::min(closest, t);
+            }
+        }
+    }
+    return closest;
+}
+
+// Distance from the robot's circle to the closest obstacle, negative when
+// they overlap
+
+double Simulator::clearance() const
+{
+    double closest = std::numeric_limits<double>::infinity();
+    for (const Polygon& polygon : world) {
+        double distance = std::numeric_limits<double>::infinity();
+        for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+            distance = std::min(distance, segment_distance(position, polygon[j], polygon[i]));
+        }
+        if (polygon.size() > 2 && inside(position, polygon)) {
+            distance = -distance;
+        }
+        closest = std::min(closest, distance);
+    }
+    return closest - robot_radius;
+}
+
+void Simulator::publish_transforms()
+{
+    std::vector<geometry_msgs::TransformStamped> transforms;
+    geometry_msgs::TransformStamped tf;
+    tf.transform.rotation.w = 1.0;
+
+    // The map is the odometry frame, odometry doesn't drift here
+    tf.header.frame_id = map_frame;
+    tf.child_frame_id = odom_frame;
+    transforms.push_back(tf);
+
+    tf.header.frame_id = base_frame;
+    tf.child_frame_id = laser_frame;
+    tf.transform.translation.x = laser_x;
+    transforms.push_back(tf);
+
+    for (size_t i = 0; i < sonars.size(); i++) {
+        tf2::Quaternion q;
+        q.setRPY(0, 0, sonars[i].yaw);
+        tf.child_frame_id = "sonar_" + std::to_string(i);
+        tf.transform.translation.x = sonars[i].position.x;
+        tf.transform.translation.y = sonars[i].position.y;
+        tf.transform.rotation.x = q.x();
+        tf.transform.rotation.y = q.y();
+        tf.transform.rotation.z = q.z();
+        tf.transform.rotation.w = q.w();
+        transforms.push_back(tf);
+    }
+    static_broadcaster.sendTransform(transforms);
+}
+
+void Simulator::publish_state(bool sensors)
+{
+    rosgraph_msgs::Clock clock;
+    clock.clock = now;
+    clock_pub.publish(clock);
+
+    tf2::Quaternion q;
+    q.setRPY(0, 0, yaw);
+
+    geometry_msgs::TransformStamped tf;
+    tf.header.stamp = now;
+    tf.header.frame_id = odom_frame;
+    tf.child_frame_id = base_frame;
+    tf.transform.translation.x = position.x;
+    tf.transform.translation.y = position.y;
+    tf.transform.rotation.x = q.x();
+    tf.transform.rotation.y = q.y();
+    tf.transform.rotation.z = q.z();
+    tf.transform.rotation.w = q.w();
+    tf_broadcaster.sendTransform(tf);
+
+    nav_msgs::Odometry odom;
+    odom.header.stamp = now;
+    odom.header.frame_id = odom_frame;
+    odom.child_frame_id = base_frame;
+    odom.pose.pose.position.x = position.x;
+    odom.pose.pose.position.y = position.y;
+    odom.pose.pose.orientation = tf.transform.rotation;
+    odom.twist.twist.linear.x = linear;
+    odom.twist.twist.angular.z = angular;
+    odom_pub.publish(odom);
+
+    if (!sensors) {
+        return;
+    }
+
+    // Beams with no return are NaN, which move_smooth skips
+    Point laser{position.x + laser_x * std::cos(yaw), position.y + laser_x * std::sin(yaw)};
+    scan.header.stamp = now;
+    for (size_t i = 0; i < scan.ranges.size(); i++) {
+        double range = cast(laser, yaw + scan.angle_min + i * scan.angle_increment, scan_range);
+        scan.ranges[i] = range < scan_range ? range : std::numeric_limits<float>::quiet_NaN();
+    }
+    scan_pub.publish(scan);
+
+    // Sonars see the closest of a few rays across their cone
+    const int rays = 5;
+    for (size_t i = 0; i < sonars.size(); i++) {
+        const Sonar& sonar = sonars[i];
+        Point origin{position.x + sonar.position.x * std::cos(yaw) - sonar.position.y * std::sin(yaw),
+                     position.y + sonar.position.x * std::sin(yaw) + sonar.position.y * std::cos(yaw)};
+        double range = sonar_range;
+        for (int j = 0; j < rays; j++) {
+            double angle = yaw + sonar.yaw + sonar_fov * (j / (rays - 1.0) - 0.5);
+            range = std::min(range, cast(origin, angle, sonar_range));
+        }
+
+        sensor_msgs::Range msg;
+        msg.header.stamp = now;
+        msg.header.frame_id = "sonar_" + std::to_string(i);
+        msg.radiation_type = sensor_msgs::Range::ULTRASOUND;
+        msg.field_of_view = sonar_fov;
+        msg.min_range = 0.02;
+        msg.max_range = sonar_range;
+        msg.range = range;
+        sonar_pub.publish(msg);
+    }
+}
+
+// Drive to one goal, returns true if it succeeded without getting closer
+// than min_clearance
+
+bool Simulator::run_goal(MoveBaseClient& client, size_t index, const Goal& goal)
+{
+    move_base_msgs::MoveBaseGoal msg;
+    tf2::Quaternion q;
+    q.setRPY(0, 0, goal.yaw);
+    msg.target_pose.header.frame_id = map_frame;
+    msg.target_pose.header.stamp = now;
+    msg.target_pose.pose.position.x = goal.position.x;
+    msg.target_pose.pose.position.y = goal.position.y;
+    msg.target_pose.pose.orientation.x = q.x();
+    msg.target_pose.pose.orientation.y = q.y();
+    msg.target_pose.pose.orientation.z = q.z();
+    msg.target_pose.pose.orientation.w = q.w();
+    ros::WallTime sent = ros::WallTime::now();
+    client.sendGoal(msg);
+
+    ros::Time start = now;
+    ros::WallTime wall_start = ros::WallTime::now();
+    double accept_time = -1.0;
+    double closest = clearance();
+    uint64_t steps = 0, missed = 0;
+    uint64_t seen;
+    {
+        const std::lock_guard<std::mutex> lock(cmd_mutex);
+        seen = cmd_count;
+    }
+
+    while (ros::ok() && !client.getState().isDone()) {
+        if (accept_time < 0.0 && client.getState() != actionlib::SimpleClientGoalState::PENDING) {
+            accept_time = (ros::WallTime::now() - sent).toSec();
+        }
+        if ((now - start).toSec() > goal_timeout) {
+            client.cancelGoal();
+            ROS_ERROR("MoveSmoothSim: Goal %zu timed out after %.1f s", index, goal_timeout);
+            break;
+        }
+
+        advance(step);
+        steps++;
+        closest = std::min(closest, clearance());
+        publish_state(steps % sensor_steps == 0);
+
+        if (!wait_for_command(seen)) {
+            missed++;
+        }
+        {
+            const std::lock_guard<std::mutex> lock(cmd_mutex);
+            seen = cmd_count;
+        }
+
+        if (realtime_factor > 0.0) {
+            ros::WallTime due = wall_start + ros::WallDuration((now - start).toSec() / realtime_factor);
+            ros::WallTime wall_now = ros::WallTime::now();
+            if (due > wall_now) {
+                (due - wall_now).sleep();
+            }
+        }
+    }
+
+    double mission_time = (now - start).toSec();
+    double wall_time = (ros::WallTime::now() - wall_start).toSec();
+    actionlib::SimpleClientGoalState state = client.getState();
+    bool succeeded = state == actionlib::SimpleClientGoalState::SUCCEEDED;
+    if (accept_time < 0.0) {
+        // done before the loop looked
+        accept_time = wall_time;
+    }
+    ROS_INFO("MoveSmoothSim: Goal %zu %s: mission time %.2f s, minimum clearance %.3f m, "
+             "%.1fx real time, %.3f ms per step, %lu steps without a command, "
+             "accepted after %.3f ms",
+             index, state.toString().c_str(), mission_time, closest,
+             wall_time > 0.0 ? mission_time / wall_time : 0.0,
+             steps ? wall_time * 1000.0 / steps : 0.0, (unsigned long) missed,
+             accept_time * 1000.0);
+    if (closest < min_clearance) {
+        ROS_ERROR("MoveSmoothSim: Goal %zu came within %.3f m of an obstacle", index, closest);
+        succeeded = false;
+    }
+    results.push_back(GoalResult{succeeded, mission_time, wall_time, closest, steps, missed,
+                                 accept_time});
+    return succeeded;
+}
+
+int Simulator::run()
+{
+    if (!load()) {
+        return 2;
+    }
+    publish_transforms();
+
+    ros::AsyncSpinner spinner(2);
+    spinner.start();
+
+    // Time stands still until move_smooth is up, so wait in wall time
+    MoveBaseClient client("move_base", false);
+    ROS_INFO("MoveSmoothSim: Waiting for move_smooth");
+    while (ros::ok() && !client.isServerConnected()) {
+        advance(step);
+        publish_state(true);
+        ros::WallDuration(0.1).sleep();
+    }
+
+    int failures = 0;
+    results.clear();
+    for (size_t i = 0; i < goals.size() && ros::ok(); i++) {
+        if (!run_goal(client, i, goals[i])) {
+            failures++;
+        }
+    }
+
+    std::string stats_service;
+    nh.param<std::string>("stats_service", stats_service, "/move_smooth/dump_stats");
+    std_srvs::Trigger stats;
+    if (ros::service::call(stats_service, stats)) {
+        ROS_INFO("MoveSmoothSim: move_smooth loop timings\n%s", stats.response.message.c_str());
+    }
+
+    ROS_INFO("MoveSmoothSim: %d of %zu goals failed", failures, goals.size());
+    return failures ? 1 : 0;
+}
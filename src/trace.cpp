@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include "move_smooth/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace trace
+{
+
+namespace
+{
+
+struct Event
+{
+  const char* name;
+  uint64_t start;
+  uint64_t duration;
+};
+
+// Written only by its thread, read when the trace is written
+struct ThreadBuffer
+{
+  int id;
+  std::string name;
+  std::vector<Event> events;
+  std::atomic<uint64_t> written;
+
+  ThreadBuffer(int id, size_t capacity) : id(id), events(capacity), written(0) {}
+};
+
+std::atomic<bool> recording(false);
+size_t buffer_capacity = 0;
+
+// Every thread's buffer, kept after the thread exits
+std::mutex buffers_mutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+thread_local ThreadBuffer* thread_buffer = nullptr;
+
+uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ThreadBuffer* get_buffer()
+{
+    if (!thread_buffer) {
+        const std::lock_guard<std::mutex> lock(buffers_mutex);
+        buffers.emplace_back(new ThreadBuffer(buffers.size() + 1, buffer_capacity));
+        thread_buffer = buffers.back().get();
+    }
+    return thread_buffer;
+}
+
+// Names are string literals, but escape them anyway
+void write_string(FILE* file, const char* text)
+{
+    fputc('"', file);
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+        }
+        if ((unsigned char) *c >= 0x20) {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+}
+
+void start(size_t capacity)
+{
+    const std::lock_guard<std::mutex> lock(buffers_mutex);
+    buffer_capacity = std::max<size_t>(capacity, 1);
+    recording.store(true, std::memory_order_release);
+}
+
+bool enabled()
+{
+    return recording.load(std::memory_order_relaxed);
+}
+
+void set_thread_name(const char* name)
+{
+    if (enabled()) {
+        get_buffer()->name = name;
+    }
+}
+
+bool write(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+
+    const std::lock_guard<std::mutex> lock(buffers_mutex);
+    fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (const auto& buffer : buffers) {
+        fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                first ? "" : ",\n", buffer->id);
+        write_string(file, buffer->name.empty() ?
+                           ("thread " + std::to_string(buffer->id)).c_str() : buffer->name.c_str());
+        fprintf(file, "}}");
+        first = false;
+
+        uint64_t written = buffer->written.load(std::memory_order_acquire);
+        size_t capacity = buffer->events.size();
+        uint64_t oldest = written > capacity ? written - capacity : 0;
+        for (uint64_t i = oldest; i < written; i++) {
+            const Event& event = buffer->events[i % capacity];
+            fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+                    buffer->id, event.start / 1000.0, event.duration / 1000.0);
+            write_string(file, event.name);
+            fprintf(file, "}");
+        }
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    return fclose(file) == 0;
+}
+
+Scope::Scope(const char* name) : name(name), start(0)
+{
+    if (enabled()) {
+        start = now_ns();
+    }
+}
+
+Scope::~Scope()
+{
+    if (!start) {
+        return;
+    }
+    ThreadBuffer* buffer = get_buffer();
+    uint64_t written = buffer->written.load(std::memory_order_relaxed);
+    Event& event = buffer->events[written % buffer->events.size()];
+    event.name = name;
+    event.start = start;
+    event.duration = now_ns() - start;
+    buffer->written.store(written + 1, std::memory_order_release);
+}
+
+}
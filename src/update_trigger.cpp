@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include "move_smooth/update_trigger.h"
+#include "move_smooth/alloc_counter.h"
+
+#include <chrono>
+
+void UpdateTrigger::notify(const ros::Time& stamp)
+{
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        if (stamp > latest_stamp) {
+            latest_stamp = stamp;
+        }
+        updates++;
+    }
+    updated.notify_all();
+}
+
+ros::Time UpdateTrigger::stamp()
+{
+    const std::lock_guard<std::mutex> lock(mutex);
+    return latest_stamp;
+}
+
+bool UpdateTrigger::wait(uint64_t seen, const ros::WallDuration& timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return updated.wait_for(lock, std::chrono::nanoseconds(timeout.toNSec()),
+                            [&]() { return updates.load() != seen; });
+}
+
+LatencyMonitor::LatencyMonitor(const char* name, double report_period,
+                               const Clock& clock) : name(name),
+                                                     clock(clock),
+                                                     report_period(report_period),
+                                                     last_report(ros::WallTime::now()),
+                                                     samples(0),
+                                                     total(0),
+                                                     max(0)
+{
+}
+
+void LatencyMonitor::record(const ros::Time& sensor_stamp)
+{
+    // nothing has arrived yet
+    if (sensor_stamp.isZero()) {
+        return;
+    }
+
+    double latency = (clock.now() - sensor_stamp).toSec();
+    samples++;
+    total += latency;
+    if (latency > max) {
+        max = latency;
+    }
+
+    ros::WallTime now = ros::WallTime::now();
+    if (now - last_report > report_period) {
+        alloc_counter::Ignore ignore;
+        ROS_INFO("%s: sensor to command latency over %lu commands: mean %.1f ms, max %.1f ms",
+                 name, (unsigned long) samples, 1000.0 * total / samples, 1000.0 * max);
+        last_report = now;
+        samples = 0;
+        total = 0;
+        max = 0;
+    }
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "move_smooth/alloc_counter.h"
+#include "move_smooth/collision_kernels.h"
+#include "move_smooth/motion_profile.h"
+#include "move_smooth/obstacle_grid.h"
+#include "move_smooth/polar_index.h"
+
+using namespace collision_kernels;
+
+namespace
+{
+
+const Footprint footprint = {0.2f, 0.1f, 0.32f};
+
+// Clouds of different sizes, some points beyond the grid and rings
+std::vector<ObstacleCloud> random_clouds(size_t count)
+{
+    std::mt19937 rng(6);
+    std::uniform_real_distribution<float> coordinate(-6.0f, 6.0f);
+    std::uniform_int_distribution<size_t> size(0, 3000);
+    std::vector<ObstacleCloud> clouds(count);
+    for (ObstacleCloud& cloud : clouds) {
+        size_t n = size(rng);
+        for (size_t i = 0; i < n; i++) {
+            cloud.push_back(coordinate(rng), coordinate(rng));
+        }
+    }
+    return clouds;
+}
+
+// An allocation the compiler can't leave out
+int* volatile sink;
+
+void allocate()
+{
+    sink = new int(1);
+    delete sink;
+}
+
+}
+
+TEST(AllocationCheck, CountsAllocations)
+{
+    ASSERT_TRUE(alloc_counter::enabled());
+    uint64_t before = alloc_counter::count();
+    allocate();
+    EXPECT_EQ(before + 1, alloc_counter::count());
+
+    {
+        alloc_counter::Ignore ignore;
+        allocate();
+    }
+    EXPECT_EQ(before + 1, alloc_counter::count());
+}
+
+TEST(AllocationCheck, WarmupIsNotChecked)
+{
+    AllocationCheck check("warmup", 3);
+    for (int i = 0; i < 3; i++) {
+        AllocationCheck::Scope scope(check);
+        allocate();
+    }
+    for (int i = 0; i < 3; i++) {
+        AllocationCheck::Scope scope(check);
+    }
+    EXPECT_EQ(0u, check.get_failures());
+}
+
+// Loops run once for each goal allocate in their first iteration as they
+// set the goal up, which is warm up again for every goal
+TEST(AllocationCheck, EachGoalWarmsUp)
+{
+    AllocationCheck check("goals", 1);
+    for (int goal = 0; goal < 2; goal++) {
+        check.restart();
+        for (int i = 0; i < 5; i++) {
+            AllocationCheck::Scope scope(check);
+            if (i == 0) {
+                allocate();
+            }
+        }
+    }
+    EXPECT_EQ(0u, check.get_failures());
+}
+
+// An iteration that leaves the loop early is checked all the same
+TEST(AllocationCheck, EarlyExitIsChecked)
+{
+    auto iteration = [](AllocationCheck& check, bool leave) {
+        AllocationCheck::Scope scope(check);
+        allocate();
+        if (leave) {
+            return;
+        }
+        allocate();
+    };
+    AllocationCheck check("early exit", 0);
+#ifdef NDEBUG
+    iteration(check, true);
+    EXPECT_EQ(1u, check.get_failures());
+#else
+    EXPECT_DEATH(iteration(check, true), "allocation in a checked iteration");
+#endif
+}
+
+// The per scan and per cycle work that runs without ROS doesn't allocate
+// once its buffers have grown to the largest cloud
+TEST(NoAllocations, ScanAndCycle)
+{
+    std::vector<ObstacleCloud> clouds = random_clouds(50);
+    ObstacleGrid grid;
+    grid.configure(0.1f, 4.0f);
+    PolarIndex index;
+    index.configure(0.1f, 5.0f, 180);
+    MotionProfile profile;
+
+    Arc arc;
+    arc.centre_y = 1.0f;
+    arc.inner_radius_sq = 0.8f * 0.8f;
+    arc.outer_radius_sq = 1.3f * 1.3f;
+    arc.outer_theta = -0.2f;
+    arc.forward = true;
+    arc.left = true;
+
+    double checksum = 0.0;
+    auto cycle = [&](const ObstacleCloud& cloud, size_t i) {
+        grid.build(cloud);
+        index.build(cloud);
+
+        DistResult dist = {100.0f, 100.0f, 100.0f, 100.0f};
+        auto fold = [&](const float* x, const float* y, size_t n) {
+            dist_points(footprint, x, y, n, dist);
+        };
+        grid.for_each_overflow(fold);
+        grid.sweep_x(true, footprint.front_length, -footprint.width, footprint.width, fold,
+                     [&]() { return dist.forward; });
+        grid.sweep_y(true, 0, -footprint.back_length, footprint.front_length, fold,
+                     [&]() { return dist.left; });
+
+        AngleResult angle = {3.14f, 3.14f};
+        float arc_angle = 3.14f;
+        index.for_each_ring(0.0f, 0.5f, 0.0f, 2.3f, [&](const float* x, const float* y, size_t n) {
+            angle_points(footprint, x, y, n, angle);
+            arc_points(arc, x, y, n, arc_angle);
+        });
+
+        profile.plan(0.1 + 0.1 * i, 0.2, 0.1, 1.0, 1.0, 3.0);
+        checksum += dist.forward + dist.left + angle.left + arc_angle +
+                    profile.velocity_at(0.05) + profile.remaining_at(0.05);
+    };
+
+    for (size_t i = 0; i < clouds.size(); i++) {
+        cycle(clouds[i], i);
+    }
+
+    AllocationCheck check("scan and cycle", 0);
+    for (size_t i = 0; i < clouds.size(); i++) {
+        AllocationCheck::Scope scope(check);
+        cycle(clouds[i], i);
+    }
+    EXPECT_EQ(0u, check.get_failures());
+    EXPECT_TRUE(std::isfinite(checksum));
+}
+
+int main(int argc, char** argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "move_smooth/clock.h"
+#include "move_smooth/obstacle_points.h"
+#include "move_smooth/runaway_check.h"
+
+namespace
+{
+
+// Wait for another thread to catch up with the clock, in wall time
+bool wait_for(const std::atomic<int>& value, int expected)
+{
+    for (int i = 0; i < 2000 && value.load() != expected; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return value.load() == expected;
+}
+
+size_t count_points(const ObstacleSnapshot& snapshot, const ros::Time& now,
+                    const ros::Duration& max_age)
+{
+    size_t n = 0;
+    snapshot.for_each_point(now, max_age, [&](float, float) { n++; });
+    return n;
+}
+
+}
+
+TEST(ManualClock, SleepersWakeWhenTheTimeIsReached)
+{
+    ManualClock clock(ros::Time(10, 0));
+    std::atomic<int> woken(0);
+    std::thread sleeper([&]() {
+        clock.sleep_until(ros::Time(11, 0));
+        woken = 1;
+    });
+
+    clock.advance(ros::Duration(0.5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(0, woken.load());
+
+    clock.advance(ros::Duration(0.5));
+    EXPECT_TRUE(wait_for(woken, 1));
+    sleeper.join();
+    EXPECT_EQ(ros::Time(11, 0), clock.now());
+}
+
+// A loop on a ClockRate runs once for each period the clock is stepped
+TEST(ClockRate, PacesOnTheClock)
+{
+    ManualClock clock(ros::Time(10, 0));
+    std::atomic<int> cycles(0);
+    std::atomic<bool> running(true);
+    ClockRate rate(clock, 10.0);
+    std::thread loop([&]() {
+        while (running) {
+            rate.sleep();
+            cycles++;
+        }
+    });
+
+    for (int i = 1; i <= 5; i++) {
+        clock.advance(ros::Duration(0.1));
+        EXPECT_TRUE(wait_for(cycles, i));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(5, cycles.load());
+
+    running = false;
+    clock.advance(ros::Duration(0.1));
+    loop.join();
+}
+
+// A loop that has fallen behind starts over rather than catching up
+TEST(ClockRate, StartsOverWhenBehind)
+{
+    ManualClock clock(ros::Time(10, 0));
+    ClockRate rate(clock, 10.0);
+    clock.advance(ros::Duration(1.0));
+    rate.sleep();
+    EXPECT_EQ(ros::Time(11, 0), clock.now());
+
+    std::atomic<int> cycles(0);
+    std::thread loop([&]() {
+        rate.sleep();
+        cycles++;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(0, cycles.load());
+    clock.advance(ros::Duration(0.1));
+    EXPECT_TRUE(wait_for(cycles, 1));
+    loop.join();
+}
+
+// Each source of points ages out on its own stamp
+TEST(ObstacleSnapshot, AgesOutOnTheClock)
+{
+    ManualClock clock(ros::Time(10, 0));
+    const ros::Duration max_age(0.5);
+
+    ObstacleSnapshot snapshot;
+    std::shared_ptr<ObstacleCloud> lidar = std::make_shared<ObstacleCloud>();
+    lidar->push_back(1.0f, 0.0f);
+    lidar->push_back(0.0f, 1.0f);
+    lidar->push_back(-1.0f, 0.0f);
+    snapshot.lidar_points = lidar;
+    snapshot.lidar_stamp = clock.now();
+    snapshot.range_points.push_back(0.5f, 0.1f);
+    snapshot.range_points.push_back(0.5f, -0.1f);
+    snapshot.range_stamps.push_back(clock.now() + ros::Duration(0.3));
+    std::shared_ptr<ObstacleCloud> test = std::make_shared<ObstacleCloud>();
+    test->push_back(0.2f, 0.2f);
+    snapshot.test_points = test;
+    snapshot.test_stamp = clock.now() + ros::Duration(0.1);
+
+    clock.advance(ros::Duration(0.4));
+    EXPECT_EQ(6u, count_points(snapshot, clock.now(), max_age));
+    clock.advance(ros::Duration(0.2));
+    EXPECT_EQ(2u, count_points(snapshot, clock.now(), max_age));
+    clock.advance(ros::Duration(0.3));
+    EXPECT_EQ(0u, count_points(snapshot, clock.now(), max_age));
+}
+
+// Moving away from a goal behind the robot aborts after the timeout
+TEST(RunawayCheck, AbortsAfterTimeout)
+{
+    ManualClock clock(ros::Time(10, 0));
+    RunawayCheck runaway(clock);
+    runaway.start(1.0, ros::Duration(1.0));
+
+    double distance = 1.0;
+    for (int i = 0; i < 10; i++) {
+        clock.advance(ros::Duration(0.1));
+        distance += 0.05;
+        EXPECT_FALSE(runaway.update(distance, M_PI)) << "after " << (i + 1) * 0.1 << " s";
+    }
+    clock.advance(ros::Duration(0.1));
+    distance += 0.05;
+    EXPECT_TRUE(runaway.update(distance, M_PI));
+}
+
+TEST(RunawayCheck, ProgressRestartsTimeout)
+{
+    ManualClock clock(ros::Time(10, 0));
+    RunawayCheck runaway(clock);
+    runaway.start(1.0, ros::Duration(1.0));
+
+    double distance = 1.0;
+    for (int i = 0; i < 40; i++) {
+        clock.advance(ros::Duration(0.1));
+        // closer every eighth cycle
+        distance += (i % 8 == 7) ? -0.05 : 0.05;
+        EXPECT_FALSE(runaway.update(distance, M_PI)) << "cycle " << i;
+    }
+}
+
+// Neither noise in the distance, a goal ahead, nor holding still counts
+TEST(RunawayCheck, OnlyMovingAwayCounts)
+{
+    ManualClock clock(ros::Time(10, 0));
+    RunawayCheck runaway(clock);
+    runaway.start(1.0, ros::Duration(1.0));
+
+    double distance = 1.0;
+    for (int i = 0; i < 30; i++) {
+        clock.advance(ros::Duration(0.1));
+        distance += 0.01;
+        EXPECT_FALSE(runaway.update(distance, M_PI));
+    }
+    for (int i = 0; i < 30; i++) {
+        clock.advance(ros::Duration(0.1));
+        distance += 0.05;
+        EXPECT_FALSE(runaway.update(distance, 0.5));
+    }
+    for (int i = 0; i < 30; i++) {
+        clock.advance(ros::Duration(0.1));
+        distance += 0.05;
+        runaway.hold();
+        EXPECT_FALSE(runaway.update(distance, M_PI));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "move_smooth/collision_kernels.h"
+#include "move_smooth/obstacle_cloud.h"
+
+using namespace collision_kernels;
+
+namespace
+{
+
+const Footprint footprint = {0.2f, 0.1f, 0.32f};
+
+// Points spread around the robot, with some on and near the footprint
+// edges where the band tests are decided
+ObstacleCloud random_cloud(std::mt19937& rng, size_t n)
+{
+    std::uniform_real_distribution<float> around(-3.0f, 3.0f);
+    std::uniform_real_distribution<float> near(-0.5f, 0.5f);
+    const float edges[] = {footprint.width, -footprint.width,
+                           footprint.front_length, -footprint.back_length, 0.0f};
+
+    ObstacleCloud cloud;
+    for (size_t i = 0; i < n; i++) {
+        switch (i % 4) {
+        case 0:
+            cloud.push_back(edges[i % 5], near(rng));
+            break;
+        case 1:
+            cloud.push_back(near(rng), edges[(i / 4) % 5]);
+            break;
+        default:
+            cloud.push_back(around(rng), around(rng));
+        }
+    }
+    return cloud;
+}
+
+DistResult dist_with(const char* name, const ObstacleCloud& cloud)
+{
+    EXPECT_TRUE(set_implementation(name));
+    DistResult result = {10.0f, 10.0f, 10.0f, 10.0f};
+    dist_points(footprint, cloud.x.data(), cloud.y.data(), cloud.size(), result);
+    return result;
+}
+
+AngleResult angle_with(const char* name, const ObstacleCloud& cloud)
+{
+    EXPECT_TRUE(set_implementation(name));
+    AngleResult result = {(float) M_PI, (float) M_PI};
+    angle_points(footprint, cloud.x.data(), cloud.y.data(), cloud.size(), result);
+    return result;
+}
+
+// The vector implementations this CPU has
+std::vector<const char*> vector_implementations()
+{
+    std::vector<const char*> names;
+    for (const char* name : {"sse4.1", "avx2"}) {
+        if (set_implementation(name)) {
+            names.push_back(name);
+        }
+    }
+    return names;
+}
+
+}
+
+TEST(CollisionKernels, ScalarIsAlwaysAvailable)
+{
+    EXPECT_TRUE(set_implementation("scalar"));
+    EXPECT_STREQ("scalar", implementation());
+    EXPECT_FALSE(set_implementation("neon"));
+    EXPECT_STREQ("scalar", implementation());
+}
+
+// Every size up to a few vectors, so that all the remainder paths run
+TEST(CollisionKernels, DistMatchesScalar)
+{
+    std::mt19937 rng(1);
+    for (const char* name : vector_implementations()) {
+        for (size_t n = 0; n < 2000; n += (n < 40 ? 1 : 97)) {
+            ObstacleCloud cloud = random_cloud(rng, n);
+            DistResult expected = dist_with("scalar", cloud);
+            DistResult actual = dist_with(name, cloud);
+            EXPECT_EQ(expected.forward, actual.forward) << name << " n " << n;
+            EXPECT_EQ(expected.rear, actual.rear) << name << " n " << n;
+            EXPECT_EQ(expected.left, actual.left) << name << " n " << n;
+            EXPECT_EQ(expected.right, actual.right) << name << " n " << n;
+        }
+    }
+}
+
+TEST(CollisionKernels, AngleMatchesScalar)
+{
+    std::mt19937 rng(2);
+    for (const char* name : vector_implementations()) {
+        for (size_t n = 0; n < 2000; n += (n < 40 ? 1 : 97)) {
+            ObstacleCloud cloud = random_cloud(rng, n);
+            AngleResult expected = angle_with("scalar", cloud);
+            AngleResult actual = angle_with(name, cloud);
+            EXPECT_NEAR(expected.left, actual.left, 1e-5) << name << " n " << n;
+            EXPECT_NEAR(expected.right, actual.right, 1e-5) << name << " n " << n;
+        }
+    }
+}
+
+// Results are folded into the running minima, not overwritten
+TEST(CollisionKernels, FoldsIntoRunningMinima)
+{
+    ObstacleCloud cloud;
+    cloud.push_back(1.0f, 0.0f);
+    for (const char* name : {"scalar", "sse4.1", "avx2"}) {
+        if (!set_implementation(name)) {
+            continue;
+        }
+        DistResult result = {0.5f, 10.0f, 10.0f, 10.0f};
+        dist_points(footprint, cloud.x.data(), cloud.y.data(), cloud.size(), result);
+        EXPECT_EQ(0.5f, result.forward) << name;
+        dist_points(footprint, cloud.x.data(), cloud.y.data(), 0, result);
+        EXPECT_EQ(0.5f, result.forward) << name;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
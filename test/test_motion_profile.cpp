@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "move_smooth/motion_profile.h"
+
+namespace
+{
+
+struct Limits
+{
+    double distance, v0, v1, max_velocity, max_acceleration, max_jerk;
+};
+
+// Check the limits at steps through the profile and the state at its end
+void check_profile(const Limits& l)
+{
+    SCOPED_TRACE(testing::Message() << "distance " << l.distance << " v0 " << l.v0
+                 << " v1 " << l.v1 << " vmax " << l.max_velocity
+                 << " amax " << l.max_acceleration << " jmax " << l.max_jerk);
+    MotionProfile profile;
+    profile.plan(l.distance, l.v0, l.v1, l.max_velocity, l.max_acceleration, l.max_jerk);
+    ASSERT_TRUE(profile.valid());
+
+    const double duration = profile.get_duration();
+    const double tolerance = 1e-6;
+    ASSERT_GE(duration, 0.0);
+    ASSERT_TRUE(std::isfinite(duration));
+
+    // Starts at rest in acceleration, from v0
+    EXPECT_NEAR(0.0, profile.position_at(0.0), tolerance);
+    EXPECT_NEAR(l.v0, profile.velocity_at(0.0), tolerance);
+    EXPECT_NEAR(0.0, profile.acceleration_at(0.0), tolerance);
+
+    // Ends at the distance, with no acceleration left. The end speed is
+    // the one asked for, or if that can't be reached, one between it and
+    // the start speed.
+    const double v_end = profile.get_end_velocity();
+    EXPECT_NEAR(l.distance, profile.position_at(duration), tolerance * std::max(1.0, l.distance));
+    EXPECT_NEAR(v_end, profile.velocity_at(duration), tolerance);
+    EXPECT_NEAR(0.0, profile.remaining_at(duration), tolerance * std::max(1.0, l.distance));
+    EXPECT_GE(v_end, std::min(l.v0, l.v1) - tolerance);
+    EXPECT_LE(v_end, std::max(l.v0, l.v1) + tolerance);
+
+    const int steps = 2000;
+    const double dt = duration / steps;
+    const double top_speed = std::max(l.max_velocity, l.v0);
+    double previous_position = 0.0;
+    double previous_acceleration = profile.acceleration_at(0.0);
+    for (int i = 1; i <= steps; i++) {
+        const double t = i * dt;
+        const double p = profile.position_at(t);
+        const double v = profile.velocity_at(t);
+        const double a = profile.acceleration_at(t - dt / 2);
+
+        ASSERT_GE(v, -tolerance) << "t " << t;
+        ASSERT_LE(v, top_speed + tolerance) << "t " << t;
+        ASSERT_LE(std::abs(a), l.max_acceleration + tolerance) << "t " << t;
+        ASSERT_GE(p, previous_position - tolerance) << "t " << t;
+        // half steps, so a step never straddles both ends of a jump
+        ASSERT_LE(std::abs(a - previous_acceleration), l.max_jerk * dt + tolerance) << "t " << t;
+
+        previous_position = p;
+        previous_acceleration = profile.acceleration_at(t);
+        ASSERT_LE(std::abs(previous_acceleration - a), l.max_jerk * dt / 2 + tolerance) << "t " << t;
+    }
+}
+
+}
+
+TEST(MotionProfile, RestToRestReachesTopSpeed)
+{
+    MotionProfile profile;
+    profile.plan(10.0, 0.0, 0.0, 0.5, 1.0, 2.0);
+    EXPECT_NEAR(0.5, profile.velocity_at(profile.get_duration() / 2), 1e-9);
+    // cruising for most of it: 10 m at 0.5 m/s plus the ramps
+    EXPECT_GT(profile.get_duration(), 20.0);
+    EXPECT_LT(profile.get_duration(), 22.0);
+    check_profile({10.0, 0.0, 0.0, 0.5, 1.0, 2.0});
+}
+
+TEST(MotionProfile, ShortMoveDoesNotReachTopSpeed)
+{
+    MotionProfile profile;
+    profile.plan(0.05, 0.0, 0.0, 2.0, 1.0, 1.0);
+    double fastest = 0.0;
+    for (int i = 0; i <= 100; i++) {
+        fastest = std::max(fastest, profile.velocity_at(profile.get_duration() * i / 100));
+    }
+    EXPECT_GT(fastest, 0.0);
+    EXPECT_LT(fastest, 2.0);
+    check_profile({0.05, 0.0, 0.0, 2.0, 1.0, 1.0});
+}
+
+TEST(MotionProfile, NoDistance)
+{
+    check_profile({0.0, 0.0, 0.0, 0.5, 1.0, 2.0});
+    MotionProfile profile;
+    profile.plan(0.0, 0.0, 0.0, 0.5, 1.0, 2.0);
+    EXPECT_NEAR(0.0, profile.get_duration(), 1e-9);
+}
+
+// Too short to slow down from 1 m/s to rest, the end speed is raised
+TEST(MotionProfile, UnreachableEndSpeed)
+{
+    MotionProfile profile;
+    profile.plan(0.01, 1.0, 0.0, 1.0, 0.5, 1.0);
+    EXPECT_GT(profile.get_end_velocity(), 0.0);
+    check_profile({0.01, 1.0, 0.0, 1.0, 0.5, 1.0});
+}
+
+TEST(MotionProfile, PassesThroughAtEndSpeed)
+{
+    MotionProfile profile;
+    profile.plan(3.0, 0.0, 0.3, 0.5, 1.0, 2.0);
+    EXPECT_NEAR(0.3, profile.get_end_velocity(), 1e-9);
+    check_profile({3.0, 0.0, 0.3, 0.5, 1.0, 2.0});
+}
+
+TEST(MotionProfile, RandomLimits)
+{
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    for (int i = 0; i < 2000; i++) {
+        Limits l;
+        l.max_velocity = 0.05 + 2.0 * unit(rng);
+        l.max_acceleration = 0.05 + 3.0 * unit(rng);
+        l.max_jerk = 0.05 + 10.0 * unit(rng);
+        l.distance = i % 10 == 0 ? 0.0 : 5.0 * std::pow(unit(rng), 3);
+        l.v0 = i % 3 == 0 ? 0.0 : l.max_velocity * unit(rng);
+        l.v1 = i % 4 == 0 ? 0.0 : l.max_velocity * unit(rng);
+        check_profile(l);
+        if (HasFatalFailure()) {
+            return;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
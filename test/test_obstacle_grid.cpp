@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+
+#include "move_smooth/collision_kernels.h"
+#include "move_smooth/obstacle_grid.h"
+
+using namespace collision_kernels;
+
+namespace
+{
+
+const Footprint footprint = {0.2f, 0.1f, 0.32f};
+const float no_obstacle = 100.0f;
+
+// Points everywhere, some of them outside the grid and some on cell
+// boundaries
+ObstacleCloud random_cloud(std::mt19937& rng, size_t n, float extent)
+{
+    std::uniform_real_distribution<float> coordinate(-1.5f * extent, 1.5f * extent);
+    std::uniform_int_distribution<int> cell(-40, 40);
+    ObstacleCloud cloud;
+    for (size_t i = 0; i < n; i++) {
+        if (i % 5 == 0) {
+            cloud.push_back(cell(rng) * 0.1f, cell(rng) * 0.1f);
+        }
+        else {
+            cloud.push_back(coordinate(rng), coordinate(rng));
+        }
+    }
+    return cloud;
+}
+
+// The obstacle_dist sweep of CollisionChecker::sweep_points, counting the
+// points looked at
+DistResult sweep(const ObstacleGrid& grid, size_t& visited)
+{
+    DistResult result = {no_obstacle, no_obstacle, no_obstacle, no_obstacle};
+    visited = 0;
+    auto fold = [&](const float* x, const float* y, size_t n) {
+        dist_points(footprint, x, y, n, result);
+        visited += n;
+    };
+
+    grid.for_each_overflow(fold);
+    grid.sweep_x(true, footprint.front_length, -footprint.width, footprint.width, fold,
+                 [&]() { return result.forward; });
+    grid.sweep_x(false, footprint.back_length, -footprint.width, footprint.width, fold,
+                 [&]() { return result.rear; });
+    grid.sweep_y(true, 0, -footprint.back_length, footprint.front_length, fold,
+                 [&]() { return result.left; });
+    grid.sweep_y(false, 0, -footprint.back_length, footprint.front_length, fold,
+                 [&]() { return result.right; });
+    return result;
+}
+
+DistResult scan(const ObstacleCloud& cloud)
+{
+    DistResult result = {no_obstacle, no_obstacle, no_obstacle, no_obstacle};
+    dist_points(footprint, cloud.x.data(), cloud.y.data(), cloud.size(), result);
+    return result;
+}
+
+}
+
+TEST(ObstacleGrid, SweepMatchesFullScan)
+{
+    std::mt19937 rng(3);
+    ObstacleGrid grid;
+    for (float cell_size : {0.05f, 0.1f, 0.37f}) {
+        grid.configure(cell_size, 2.0f);
+        for (size_t n : {0, 1, 2, 10, 100, 1000, 5000}) {
+            ObstacleCloud cloud = random_cloud(rng, n, 2.0f);
+            // the grid is reused, as it is for each scan
+            grid.build(cloud);
+            EXPECT_EQ(n, grid.size());
+
+            size_t visited;
+            DistResult expected = scan(cloud);
+            DistResult actual = sweep(grid, visited);
+            EXPECT_EQ(expected.forward, actual.forward) << "cell " << cell_size << " n " << n;
+            EXPECT_EQ(expected.rear, actual.rear) << "cell " << cell_size << " n " << n;
+            EXPECT_EQ(expected.left, actual.left) << "cell " << cell_size << " n " << n;
+            EXPECT_EQ(expected.right, actual.right) << "cell " << cell_size << " n " << n;
+        }
+    }
+}
+
+// With obstacles close by on all sides most of the cloud is never looked at
+TEST(ObstacleGrid, SweepStopsEarly)
+{
+    std::mt19937 rng(4);
+    ObstacleGrid grid;
+    grid.configure(0.1f, 10.0f);
+    std::uniform_real_distribution<float> coordinate(-10.0f, 10.0f);
+    ObstacleCloud cloud;
+    for (size_t i = 0; i < 20000; i++) {
+        cloud.push_back(coordinate(rng), coordinate(rng));
+    }
+    cloud.push_back(0.5f, 0.0f);
+    cloud.push_back(-0.5f, 0.0f);
+    cloud.push_back(0.0f, 0.5f);
+    cloud.push_back(0.0f, -0.5f);
+    grid.build(cloud);
+
+    size_t visited;
+    DistResult expected = scan(cloud);
+    DistResult actual = sweep(grid, visited);
+    EXPECT_GE(0.5f, actual.forward);
+    EXPECT_EQ(expected.forward, actual.forward);
+    EXPECT_EQ(expected.rear, actual.rear);
+    EXPECT_EQ(expected.left, actual.left);
+    EXPECT_EQ(expected.right, actual.right);
+    EXPECT_LT(visited, cloud.size() / 20);
+}
+
+// The points looked at depend on what is close to the robot, not on how
+// many points there are further away: a room with walls half a metre
+// away and from 1k to 100k points of clutter beyond them
+TEST(ObstacleGrid, SweepCostIsFlat)
+{
+    std::mt19937 rng(5);
+    ObstacleGrid grid;
+    grid.configure(0.1f, 10.0f);
+    std::uniform_real_distribution<float> coordinate(-10.0f, 10.0f);
+
+    size_t first_visited = 0;
+    for (size_t n : {1000, 10000, 100000}) {
+        ObstacleCloud cloud;
+        for (float t = -0.5f; t < 0.5f; t += 0.02f) {
+            cloud.push_back(0.5f, t);
+            cloud.push_back(-0.6f, t);
+            cloud.push_back(t, 0.5f);
+            cloud.push_back(t, -0.5f);
+        }
+        while (cloud.size() < n) {
+            float x = coordinate(rng), y = coordinate(rng);
+            if (std::hypot(x, y) > 2.0f) {
+                cloud.push_back(x, y);
+            }
+        }
+        grid.build(cloud);
+
+        size_t visited;
+        DistResult expected = scan(cloud);
+        DistResult actual = sweep(grid, visited);
+        EXPECT_EQ(expected.forward, actual.forward) << "n " << n;
+        EXPECT_EQ(expected.rear, actual.rear) << "n " << n;
+        EXPECT_EQ(expected.left, actual.left) << "n " << n;
+        EXPECT_EQ(expected.right, actual.right) << "n " << n;
+
+        if (first_visited == 0) {
+            first_visited = visited;
+        }
+        EXPECT_GT(first_visited, 0u);
+        EXPECT_EQ(first_visited, visited) << "n " << n;
+    }
+}
+
+TEST(ObstacleGrid, EmptyCloud)
+{
+    ObstacleGrid grid;
+    grid.configure(0.1f, 2.0f);
+    grid.build(ObstacleCloud());
+    size_t visited;
+    DistResult result = sweep(grid, visited);
+    EXPECT_EQ(0u, visited);
+    EXPECT_EQ(no_obstacle, result.forward);
+}
+
+int main(int argc, char** argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2020, Ubiquity Robotics
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are
+ * those of the authors and should not be interpreted as representing official
+ * policies, either expressed or implied, of the FreeBSD Project.
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ros/ros.h>
+#include <std_srvs/Trigger.h>
+
+#include "move_smooth/Stop.h"
+#include "move_smooth/simulator.h"
+
+namespace
+{
+
+// Poll done() in wall time, returns false if it isn't done by timeout
+template <typename F>
+bool wait_for(F done, double timeout)
+{
+    ros::WallTime end = ros::WallTime::now() + ros::WallDuration(timeout);
+    while (!done()) {
+        if (ros::WallTime::now() > end) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// A column of a stage in the dump_stats table, -1 if it isn't there
+double stage_stat(const std::string& dump, const std::string& stage, int column)
+{
+    std::istringstream lines(dump);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        fields >> name;
+        if (name != stage) {
+            continue;
+        }
+        double value = -1.0;
+        for (int i = 0; i < column; i++) {
+            if (!(fields >> value)) {
+                return -1.0;
+            }
+        }
+        return value;
+    }
+    return -1.0;
+}
+
+// Columns of the dump_stats table
+const int stat_count = 1;
+const int stat_max_us = 7;
+
+// Latch the stop while the robot drives, check that it holds still,
+// then let it go on
+void stop_while_driving(Simulator& sim)
+{
+    double linear, angular;
+    ASSERT_TRUE(wait_for([&] { sim.get_command(linear, angular); return linear > 0.05; }, 60.0))
+        << "the robot never drove";
+
+    move_smooth::Stop stop;
+    stop.request.stop = true;
+    ASSERT_TRUE(ros::service::call("/stop_move", stop));
+    // Commands sent before the stop may still be on their way
+    EXPECT_TRUE(wait_for([&] {
+        sim.get_command(linear, angular);
+        return linear == 0.0 && angular == 0.0;
+    }, 1.0));
+    uint64_t seen = sim.get_command(linear, angular);
+    for (uint64_t count = seen; count < seen + 5;) {
+        ASSERT_TRUE(wait_for([&] { return sim.get_command(linear, angular) > count; }, 1.0));
+        count = sim.get_command(linear, angular);
+        EXPECT_EQ(0.0, linear);
+        EXPECT_EQ(0.0, angular);
+    }
+
+    stop.request.stop = false;
+    ASSERT_TRUE(ros::service::call("/stop_move", stop));
+}
+
+}
+
+// The missions of launch/simulate.yaml succeed without touching the
+// world, even with a stop on the way, each goal is taken on quickly and
+// the simulation keeps well ahead of real time
+TEST(Simulate, Missions)
+{
+    ros::NodeHandle nh("~");
+    double min_realtime_factor, max_stop_latency, max_accept_time;
+    nh.param<double>("min_realtime_factor", min_realtime_factor, 100.0);
+    nh.param<double>("max_stop_latency", max_stop_latency, 0.001);
+    nh.param<double>("max_accept_time", max_accept_time, 0.05);
+
+    Simulator sim;
+    int status = -1;
+    std::thread missions([&] { status = sim.run(); });
+    stop_while_driving(sim);
+    missions.join();
+    EXPECT_EQ(0, status);
+
+    const std::vector<GoalResult>& results = sim.get_results();
+    ASSERT_FALSE(results.empty());
+    double mission_time = 0.0, wall_time = 0.0;
+    for (size_t i = 0; i < results.size(); i++) {
+        EXPECT_TRUE(results[i].succeeded) << "goal " << i;
+        EXPECT_GE(results[i].clearance, 0.0) << "goal " << i;
+        // Handed to the waiting execute thread straight away, not when
+        // it next polls
+        EXPECT_LE(results[i].accept_time, max_accept_time) << "goal " << i;
+        mission_time += results[i].mission_time;
+        wall_time += results[i].wall_time;
+    }
+    ASSERT_GT(wall_time, 0.0);
+    double realtime_factor = mission_time / wall_time;
+    RecordProperty("realtime_factor", std::to_string(realtime_factor));
+    EXPECT_GE(realtime_factor, min_realtime_factor)
+        << mission_time << " s of missions took " << wall_time << " s";
+
+    // From the stop request to the zero command on cmd_vel, as timed by
+    // move_smooth
+    std_srvs::Trigger stats;
+    ASSERT_TRUE(ros::service::call("/move_smooth/dump_stats", stats));
+    EXPECT_EQ(1.0, stage_stat(stats.response.message, "stop_latency", stat_count));
+    double stop_latency = stage_stat(stats.response.message, "stop_latency", stat_max_us);
+    RecordProperty("stop_latency_us", std::to_string(stop_latency));
+    EXPECT_LE(stop_latency, max_stop_latency * 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    ros::init(argc, argv, "test_simulate");
+    return RUN_ALL_TESTS();
+}